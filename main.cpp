@@ -32,59 +32,39 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE /* hPrevInstance */,
   auto vis = platform(eventDispatch);
   vis.openWindow("test app", 800, 600);
 
-  // for the display list, only pointers are used.
-  // this enables the changing of data without any copy.
-  // all data from the uxdevice is external from it.
-  // The shared pointer is used.
+  // the display list holds its values. Strings and images are added to the
+  // pools of the list and the nodes name them by index. The list is edited
+  // within a transaction, which any thread may make. Its changes are drawn
+  // once it is committed. The builder adds the nodes of each item and
+  // leaves out a face or color that is already in effect.
   // typically an api is used to fill these structures.
-  auto coordinates = make_shared<rectangle>(10, 10, 300, 300);
-  auto textInfo = make_shared<string>("client data");
-  auto color = make_shared<unsigned int>(0x00);
-  auto ptSize = make_shared<int>(10);
-  auto aln = make_shared<char>('l');
-  auto tf = make_shared<string>("arial");
-  auto idx1 = make_shared<size_t>(0);
-  auto idx2 = make_shared<size_t>(textInfo->size());
+  displayTransaction t = vis.transaction();
+  displayBuilder build(*t);
+  build.reserve(16, 4);
 
-  vis.data().push_back(stringData{textInfo});
-  vis.data().push_back(textFace{tf, ptSize});
-  vis.data().push_back(textColor{color});
-  vis.data().push_back(textAlignment{aln});
-  vis.data().push_back(targetArea{coordinates});
-  vis.data().push_back(drawText{idx1, idx2});
+  build.face("arial", 10).color(0x00).alignment('l');
+  build.area(rectangle(10, 10, 300, 300)).text("client data");
 
   stringstream ss;
   for(int i=0;i<100;i++) {
     ss << "Info " << i << " 0876543&*^%$##  5555555555555555hhh]\tttttthhhhhhhhhhhjjjjjjjjjjjjjjjjjjjj\n";
   }
 
-  auto coordinates2 = make_shared<rectangle>(30, 30, 600, 600);
-  auto color2 = make_shared<unsigned int>(0x0000ff);
-  auto textInfo2 = make_shared<string>(ss.str());
-  auto idx1b = make_shared<size_t>(0);
-  auto idx2b = make_shared<size_t>(textInfo2->size());
+  build.color(0x0000ff);
+  build.area(rectangle(30, 30, 600, 600)).text(ss.str());
 
-  vis.data().push_back(stringData{textInfo2});
-  vis.data().push_back(textColor{color2});
-  vis.data().push_back(targetArea{coordinates2});
-  vis.data().push_back(drawText{idx1b, idx2b});
 
-
-  auto coordinates3 = make_shared<rectangle>(200, 200, 500, 500);
   //auto imageFileName = make_shared<string>("/home/anthony/source/nanosvg/example/drawing.svg");
   auto imageFileName = make_shared<string>("/home/anthony/source/nanosvg/example/screenshot-2.png");
 //  auto imageFileName = make_shared<string>("plasma:fractal");
-  vis.data().push_back(targetArea{coordinates3});
-  vis.data().push_back(imageData{imageFileName});
-  vis.data().push_back(drawImage{});
+  build.area(rectangle(200, 200, 500, 500)).image(imageData{imageFileName});
 
 
-  auto coordinates4 = make_shared<rectangle>(400, 200, 900, 500);
   //auto imageFileName = make_shared<string>("/home/anthony/source/nanosvg/example/drawing.svg");
   auto imageFileName2 = make_shared<string>("/home/anthony/source/nanosvg/example/draw.png");
-  vis.data().push_back(targetArea{coordinates4});
-  vis.data().push_back(imageData{imageFileName2});
-  vis.data().push_back(drawImage{});
+  build.area(rectangle(400, 200, 900, 500))
+      .image(imageData{imageFileName2}, imageFit::fit);
+  t.commit();
 
   vis.dirty(0);
   int width = vis.pixelWidth(0);
@@ -0,0 +1,56 @@
+/**
+\file rawconvert.cpp
+
+\author Anthony Matarazzo
+
+\date 10/18/26
+\version 1.0
+*/
+
+/**
+\brief converts image files, such as png or svg, to the raw pixel format
+which is mapped by imageData without decoding.
+
+usage: rawconvert.out [-m] [-s scale] input output
+  -m   also store the mip levels of the image.
+  -s   the device scale an svg is rasterized for, 1 by default.
+*/
+#include "uxdevice.hpp"
+
+using namespace std;
+using namespace uxdevice;
+
+int main(int argc, char **argv) {
+  bool bMipLevels = false;
+  double dScale = 1.0;
+  vector<string> files;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-m")
+      bMipLevels = true;
+    else if (arg == "-s" && i + 1 < argc)
+      dScale = atof(argv[++i]);
+    else
+      files.push_back(arg);
+  }
+
+  if (files.size() != 2) {
+    cout << "usage: " << argv[0] << " [-m] [-s scale] input output" << endl;
+    return 1;
+  }
+
+#ifdef USE_IMAGE_MAGICK
+  Magick::InitializeMagick(*argv);
+#endif
+
+  try {
+    imageData image(make_shared<string>(files[0]));
+    image.writeRaw(files[1], bMipLevels, dScale);
+  } catch (const std::exception &e) {
+    cout << e.what() << endl;
+    return 1;
+  }
+
+  return 0;
+}
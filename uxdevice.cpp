@@ -24,76 +24,460 @@
 
 #include <sys/types.h>
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// code for later instruction sets is compiled with target attributes and
+// selected at run time.
+#if defined(__GNUC__) && defined(__SSE2__) &&                                  \
+    (defined(__x86_64__) || defined(__i386__))
+#define PIXEL_CONVERT_DISPATCH
+#include <immintrin.h>
+#endif
+
 using namespace std;
 using namespace uxdevice;
 
 /**
 \internal
-\brief The routine iterates the display list moving
-parameters to the class member communication areas.
-If processing is requested, the function operation
-is
-invoked.
+\brief renders the display list, the one published when none is given.
 */
-void uxdevice::platform::render(void) {
-
-#if defined(USE_IMAGE_MAGICK)
-  m_offscreenImage.modifyImage();
-  Magick::Pixels view(m_offscreenImage);
-  m_offscreenBuffer = view.get(0,0,m_offscreenImage.columns(),m_offscreenImage.rows());
-#endif // defined
-
-  for (auto &n : DL) {
-    if (holds_alternative<stringData>(n)) {
-      m_stringData = get<stringData>(n).data;
+void uxdevice::platform::render(std::shared_ptr<const displayList> list) {
+  m_drawnList = list ? list : published();
+  m_drawnScale = fontScale;
+  render(*m_drawnList, fontScale);
+  m_drawnGeneration = m_drawnList->generation();
+  m_bSceneChanged = false;
+}
 
-    } else if (holds_alternative<imageData>(n)) {
+/**
+\internal
+\brief The routine iterates the display list moving parameters to the class
+member communication areas. If processing is requested, the function
+operation is invoked. The render thread passes a snapshot of the display
+list and the font scale at the time it was taken. Items hidden by the images
+drawn after them or lying outside the clips pushed are skipped, others are
+clipped to their visible part. The target area of an item is mapped by the
+transform in effect when it is drawn. With sortState set, the items are
+drawn grouped by their state.
+*/
+void uxdevice::platform::render(const displayList &list, const int scale) {
+  m_renderScale = scale;
+  m_surface.unclip();
+
+  // the text and face of the last frame refer to the pools of its list,
+  // which may be released. The list drawn sets its own.
+  m_stringData = std::string_view();
+  m_textFace = std::string_view();
+
+  occlude(list);
+
+  // a node is drawn clipped to its visible part, which lies within its
+  // target area.
+  auto visible = [this](const std::size_t idx) {
+    const rectangle &v = m_visible[idx];
+    if (v.x1 >= v.x2 || v.y1 >= v.y2)
+      return false;
+    m_surface.clip(v);
+    return true;
+  };
+
+  if (m_bSortState) {
+    renderSorted(list);
+    evictImages();
+    return;
+  }
 
-#if defined(USE_STB_IMAGE)
-      m_imageData = get<imageData>(n).data;
-      m_width = get<imageData>(n).width;
-      m_height = get<imageData>(n).height;
+  // the transform in effect places the target area of each item.
+  std::vector<affine> transforms(1);
+  auto place = [&]() {
+    m_transform = transforms.back();
+    m_targetArea = m_transform.map(m_localArea);
+  };
 
-#elif defined(USE_IMAGE_MAGICK)
-      m_image = get<imageData>(n).data;
+  std::size_t idx = 0;
+  for (auto &n : list) {
+    if (holds_alternative<stringData>(n)) {
+      m_stringData = list.string(get<stringData>(n).text);
 
-#endif // USE_IMAGE_MAGICK
+    } else if (holds_alternative<imageSource>(n)) {
+      const imageData &image = list.image(get<imageSource>(n).image);
+      m_imagePixels = image.cache;
+      m_imageTiles = image.tiles;
+      trackImage(m_imagePixels);
 
     } else if (holds_alternative<textFace>(n)) {
-      m_textFace = get<textFace>(n).data;
+      m_textFace = list.string(get<textFace>(n).face);
       m_pointSize = get<textFace>(n).pointSize;
       activateTextFace();
 
     } else if (holds_alternative<textColor>(n)) {
       m_textColor = get<textColor>(n).data;
       // get color components of the foreground color used later.
-      m_textColorR = *m_textColor >> 16;
-      m_textColorG = *m_textColor >> 8;
-      m_textColorB = *m_textColor;
+      m_textColorR = m_textColor >> 16;
+      m_textColorG = m_textColor >> 8;
+      m_textColorB = m_textColor;
 
     } else if (holds_alternative<textAlignment>(n)) {
       m_textAlignment = get<textAlignment>(n).data;
 
     } else if (holds_alternative<targetArea>(n)) {
-      m_targetArea = get<targetArea>(n).data;
+      m_localArea = get<targetArea>(n).data;
+
+    } else if (holds_alternative<pushTransform>(n)) {
+      transforms.push_back(transforms.back() * get<pushTransform>(n).data);
+
+    } else if (holds_alternative<popTransform>(n)) {
+      if (transforms.size() > 1)
+        transforms.pop_back();
 
     } else if (holds_alternative<drawText>(n)) {
-      const size_t &beginIndex = *get<drawText>(n).beginIndex;
-      const size_t &endIndex = *get<drawText>(n).endIndex;
-
-      renderText(beginIndex, endIndex);
+      const drawText &dt = get<drawText>(n);
+      if (visible(idx)) {
+        place();
+        renderText(dt.beginIndex, dt.endIndex);
+      }
 
     } else if (holds_alternative<drawImage>(n)) {
-      const rectangle &src = *get<drawImage>(n).src;
-      renderImage(src);
+      if (visible(idx)) {
+        place();
+        renderImage(get<drawImage>(n));
+      }
+    }
+    idx++;
+  }
+
+  evictImages();
+}
+/**
+\internal
+\brief draws the visible items grouped by the state they are drawn with, so
+that each face, color or image is selected once per group rather than once
+per item. An item is given a slot one past the latest slot of the items
+before it that it overlaps, and it joins the latest group of its state when
+that group is at or past the slot. Otherwise a group is started. Groups are
+drawn in the order they were started, so an item is always drawn after the
+items beneath it. Overlap is found on a grid of 64 pixel cells.
+*/
+void uxdevice::platform::renderSorted(const displayList &list) {
+  typedef struct {
+    std::size_t node;
+    std::uint32_t face;
+    int pointSize;
+    unsigned int color;
+    char alignment;
+    rectangle area;
+    affine transform;
+    std::string_view text;
+    const imageData *image;
+  } item;
+  typedef std::tuple<bool, std::uint32_t, int, unsigned int, char, double,
+                     double, const imageData *>
+      stateKey;
+  const std::uint32_t noFace = std::numeric_limits<std::uint32_t>::max();
+
+  // the state in effect before the first node is that of the last frame.
+  item state{0,
+             noFace,
+             m_pointSize,
+             m_textColor,
+             m_textAlignment,
+             m_localArea,
+             affine(),
+             m_stringData,
+             nullptr};
+  std::vector<affine> transforms(1);
+  std::vector<item> items;
+  std::size_t idx = 0;
+
+  for (auto &n : list) {
+    if (holds_alternative<stringData>(n)) {
+      state.text = list.string(get<stringData>(n).text);
+    } else if (holds_alternative<imageSource>(n)) {
+      state.image = &list.image(get<imageSource>(n).image);
+    } else if (holds_alternative<textFace>(n)) {
+      state.face = get<textFace>(n).face;
+      state.pointSize = get<textFace>(n).pointSize;
+    } else if (holds_alternative<textColor>(n)) {
+      state.color = get<textColor>(n).data;
+    } else if (holds_alternative<textAlignment>(n)) {
+      state.alignment = get<textAlignment>(n).data;
+    } else if (holds_alternative<targetArea>(n)) {
+      state.area = get<targetArea>(n).data;
+    } else if (holds_alternative<pushTransform>(n)) {
+      transforms.push_back(transforms.back() * get<pushTransform>(n).data);
+      state.transform = transforms.back();
+    } else if (holds_alternative<popTransform>(n)) {
+      if (transforms.size() > 1)
+        transforms.pop_back();
+      state.transform = transforms.back();
+    } else if ((holds_alternative<drawText>(n) ||
+                (holds_alternative<drawImage>(n) && state.image)) &&
+               m_visible[idx].x1 < m_visible[idx].x2 &&
+               m_visible[idx].y1 < m_visible[idx].y2) {
+      state.node = idx;
+      items.push_back(state);
+    }
+    idx++;
+  }
+
+  // the latest slot drawn within each cell.
+  const int cell = 64;
+  const rectangle limit = m_surface.clipArea();
+  const int columns = (limit.x2 - limit.x1 + cell - 1) / cell;
+  const int rows = (limit.y2 - limit.y1 + cell - 1) / cell;
+  std::vector<int> cells(static_cast<std::size_t>(columns) * rows, -1);
+  std::vector<std::vector<std::size_t>> groups;
+  std::map<stateKey, std::size_t> latest;
+
+  for (std::size_t i = 0; i < items.size(); i++) {
+    const item &it = items[i];
+    const rectangle &v = m_visible[it.node];
+    const bool bImage = holds_alternative<drawImage>(list[it.node]);
+    const int cx1 = (v.x1 - limit.x1) / cell;
+    const int cy1 = (v.y1 - limit.y1) / cell;
+    const int cx2 = (v.x2 - limit.x1 - 1) / cell;
+    const int cy2 = (v.y2 - limit.y1 - 1) / cell;
+
+    int slot = 0;
+    for (int y = cy1; y <= cy2; y++)
+      for (int x = cx1; x <= cx2; x++)
+        slot = std::max(slot, cells[y * columns + x] + 1);
+
+    stateKey key =
+        bImage ? stateKey(true, 0, 0, 0, 0, 0.0, 0.0, it.image)
+               : stateKey(false, it.face, it.pointSize, it.color,
+                          it.alignment, it.transform.scaleX(),
+                          it.transform.scaleY(), nullptr);
+    auto found = latest.find(key);
+    std::size_t group;
+    if (found != latest.end() && static_cast<int>(found->second) >= slot) {
+      group = found->second;
+    } else {
+      group = groups.size();
+      groups.emplace_back();
+      latest[key] = group;
+    }
+    groups[group].push_back(i);
+
+    for (int y = cy1; y <= cy2; y++)
+      for (int x = cx1; x <= cx2; x++)
+        cells[y * columns + x] =
+            std::max(cells[y * columns + x], static_cast<int>(group));
+  }
+
+  // the state is selected as it changes.
+  std::uint32_t activeFace = noFace;
+  int activePointSize = 0;
+  const imageData *activeImage = nullptr;
+
+  for (auto &group : groups) {
+    for (auto i : group) {
+      const item &it = items[i];
+      const displayListType &n = list[it.node];
+      m_localArea = it.area;
+      m_transform = it.transform;
+      m_targetArea = m_transform.map(m_localArea);
+      m_textAlignment = it.alignment;
+      m_surface.clip(m_visible[it.node]);
+
+      if (holds_alternative<drawImage>(n)) {
+        if (it.image != activeImage) {
+          activeImage = it.image;
+          m_imagePixels = it.image->cache;
+          m_imageTiles = it.image->tiles;
+          trackImage(m_imagePixels);
+        }
+        renderImage(get<drawImage>(n));
+        continue;
+      }
+
+      if (it.face != noFace &&
+          (it.face != activeFace || it.pointSize != activePointSize)) {
+        activeFace = it.face;
+        activePointSize = it.pointSize;
+        m_textFace = list.string(it.face);
+        m_pointSize = it.pointSize;
+        activateTextFace();
+      }
+      m_textColor = it.color;
+      m_textColorR = m_textColor >> 16;
+      m_textColorG = m_textColor >> 8;
+      m_textColorB = m_textColor;
+      m_stringData = it.text;
+
+      const drawText &dt = get<drawText>(n);
+      renderText(dt.beginIndex, dt.endIndex);
     }
   }
+}
 
-#if defined(USE_IMAGE_MAGICK)
-  view.sync();
-#endif // defined
+/**
+\internal
+\brief returns the intersection of a and b, empty when x1 >= x2 or
+y1 >= y2.
+*/
+static inline rectangle intersectRectangle(const rectangle &a,
+                                           const rectangle &b) {
+  return rectangle(std::max(a.x1, b.x1), std::max(a.y1, b.y1),
+                   std::min(a.x2, b.x2), std::min(a.y2, b.y2));
+}
+
+/**
+\internal
+\brief removes the rectangle o from the pieces.
+*/
+static void subtractRectangle(std::vector<rectangle> &pieces,
+                              const rectangle &o) {
+  std::vector<rectangle> out;
+  for (auto &p : pieces) {
+    if (o.x2 <= p.x1 || o.x1 >= p.x2 || o.y2 <= p.y1 || o.y1 >= p.y2) {
+      out.push_back(p);
+      continue;
+    }
+    int y1 = std::max(p.y1, o.y1);
+    int y2 = std::min(p.y2, o.y2);
+    if (o.y1 > p.y1)
+      out.emplace_back(p.x1, p.y1, p.x2, o.y1);
+    if (o.y2 < p.y2)
+      out.emplace_back(p.x1, o.y2, p.x2, p.y2);
+    if (o.x1 > p.x1)
+      out.emplace_back(p.x1, y1, o.x1, y2);
+    if (o.x2 < p.x2)
+      out.emplace_back(o.x2, y1, p.x2, y2);
+  }
+  pieces.swap(out);
+}
+
+/**
+\internal
+\brief finds the parts of the draw nodes that are not hidden by the images
+drawn after them. Images are copied to the surface, so the area an image
+covers hides what is beneath it. The list is walked from the last item to
+the first, collecting the covered areas. m_visible holds, for each draw
+node, the bounds of its visible part. An empty rectangle means the node is
+hidden, either covered or outside the clips pushed, so it is rejected
+without being laid out. Vector images, which may not be rasterized yet,
+evicted images and images that are rotated do not hide other items.
+*/
+void uxdevice::platform::occlude(const displayList &list) {
+  typedef struct {
+    std::size_t node;
+    rectangle area;
+    rectangle clip;
+    affine transform;
+    const imageData *image;
+  } item;
+
+  const rectangle limit = m_surface.clipArea();
+  std::vector<item> items;
+  std::vector<rectangle> clips(1, limit);
+  std::vector<affine> transforms(1);
+  rectangle area = limit;
+  const imageData *image = nullptr;
+  std::size_t idx = 0;
+
+  // nested clips intersect, the top of the stack is the clip in effect. The
+  // area of an item is mapped by the transform in effect.
+  for (auto &n : list) {
+    if (holds_alternative<targetArea>(n))
+      area = get<targetArea>(n).data;
+    else if (holds_alternative<pushClip>(n))
+      clips.push_back(intersectRectangle(
+          clips.back(), transforms.back().map(get<pushClip>(n).data)));
+    else if (holds_alternative<popClip>(n)) {
+      if (clips.size() > 1)
+        clips.pop_back();
+    } else if (holds_alternative<pushTransform>(n))
+      transforms.push_back(transforms.back() * get<pushTransform>(n).data);
+    else if (holds_alternative<popTransform>(n)) {
+      if (transforms.size() > 1)
+        transforms.pop_back();
+    } else if (holds_alternative<imageSource>(n))
+      image = &list.image(get<imageSource>(n).image);
+    else if (holds_alternative<drawText>(n))
+      items.push_back(item{idx, transforms.back().map(area), clips.back(),
+                           transforms.back(), nullptr});
+    else if (holds_alternative<drawImage>(n))
+      items.push_back(item{idx, transforms.back().map(area), clips.back(),
+                           transforms.back(), image});
+    idx++;
+  }
+
+  m_visible.assign(list.size(), limit);
+  std::vector<rectangle> covered;
+  std::vector<rectangle> pieces;
+  auto size = [](const rectangle &r) {
+    return static_cast<long>(r.x2 - r.x1) * (r.y2 - r.y1);
+  };
+
+  for (auto it = items.rbegin(); it != items.rend(); ++it) {
+    rectangle bounds = intersectRectangle(it->area, it->clip);
+    if (bounds.x1 >= bounds.x2 || bounds.y1 >= bounds.y2) {
+      m_visible[it->node] = rectangle(0, 0, 0, 0);
+      continue;
+    }
+
+    // the visible part is the bounds of what the covered areas leave.
+    pieces.assign(1, bounds);
+    for (auto &c : covered) {
+      subtractRectangle(pieces, c);
+      if (pieces.empty() || pieces.size() > OCCLUSION_RECTS)
+        break;
+    }
+    rectangle &visible = m_visible[it->node];
+    visible = rectangle(0, 0, 0, 0);
+    if (!pieces.empty()) {
+      visible = pieces.front();
+      for (auto &p : pieces)
+        visible = rectangle(std::min(visible.x1, p.x1),
+                            std::min(visible.y1, p.y1),
+                            std::max(visible.x2, p.x2),
+                            std::max(visible.y2, p.y2));
+    }
+
+    // a visible image hides the items before it.
+    const imageData *img = it->image;
+    if (pieces.empty() || !img || !img->cache || img->cache->isVector() ||
+        img->cache->evicted() || !it->transform.isAxisAligned())
+      continue;
+    drawImage di = get<drawImage>(list[it->node]);
+    imagePlacement place =
+        placeImage(di, it->area, *img->cache, img->tiles, it->transform.xx,
+                   it->transform.yy);
+    rectangle c = intersectRectangle(
+        rectangle(place.destX, place.destY, place.destX + place.destWidth,
+                  place.destY + place.destHeight),
+        bounds);
+    if (c.x1 >= c.x2 || c.y1 >= c.y2)
+      continue;
+
+    // the largest areas are kept.
+    if (covered.size() < OCCLUSION_RECTS) {
+      covered.push_back(c);
+    } else {
+      auto smallest = std::min_element(
+          covered.begin(), covered.end(),
+          [&](const rectangle &a, const rectangle &b) {
+            return size(a) < size(b);
+          });
+      if (size(*smallest) < size(c))
+        *smallest = c;
+    }
+  }
 }
 
+
 /**
 \internal
 \brief a simple test of the pointer and shared memory .
@@ -101,16 +485,13 @@ void uxdevice::platform::render(void) {
 // change data on mouse move
 void uxdevice::platform::test(int x, int y) {
 return;
-  for (auto &n : DL) {
+  displayTransaction t = transaction();
+  for (std::size_t idx = 0; idx < t->size(); idx++) {
     // visit based upon type, from std c++ reference example
-    if (holds_alternative<targetArea>(n)) {
-      m_targetArea = get<targetArea>(n).data;
-      m_targetArea->x1 = x;
-      m_targetArea->y1 = y;
-      m_targetArea->x2 = x + 600;
-      m_targetArea->y2 = y + 600;
-    }
+    if (holds_alternative<targetArea>((*t)[idx]))
+      get<targetArea>(t->write(idx)).data = rectangle(x, y, x + 600, y + 600);
   }
+  t.commit();
 }
 
 /*
@@ -122,11 +503,38 @@ necessary operation.
 */
 void uxdevice::platform::dispatchEvent(const event &evt) {
   switch (evt.evtType) {
-  case eventType::paint:
+  case eventType::paint: {
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
+    // a scroll which is the only change of the frame moves the pixels.
+    std::shared_ptr<const displayList> list = published();
+    bool bDrawn =
+        scrollOnly(*list) && scrollFrame(*list, fontScale, m_scrolls.front());
+    m_scrolls.clear();
+
+    // otherwise the items that differ from the list drawn are drawn again.
+    // When they cover too much, the frame is drawn whole and the damage is
+    // what is presented.
+    std::optional<std::vector<rectangle>> damage;
+    if (!bDrawn && !m_bSceneChanged && m_drawnList &&
+        m_drawnScale == fontScale) {
+      damage = displayDiff(*m_drawnList, *list).damage();
+      bDrawn = damageFrame(*list, fontScale, *damage);
+    }
+
+    if (bDrawn) {
+      m_drawnList = list;
+      m_drawnGeneration = list->generation();
+      break;
+    }
+    clear();
+    render(list);
+    flip(damage);
+#else
     clear();
     render();
     flip();
-    break;
+#endif
+  } break;
   case eventType::resize:
     resize(evt.width, evt.height);
     //    render();
@@ -156,18 +564,15 @@ void uxdevice::platform::dispatchEvent(const event &evt) {
     if (fontScale > 100)
       fontScale = 100;
 
-    dispatchEvent(event{eventType::paint});
+    requestFrame();
     break;
   case eventType::wheel:
-    if (evt.wheelDistance > 0)
-      fontScale += 1;
-    else
-      fontScale -= 1;
+    fontScale += evt.wheelDistance;
     if (fontScale < 5)
       fontScale = 5;
     if (fontScale > 100)
       fontScale = 100;
-    dispatchEvent(event{eventType::paint});
+    requestFrame();
     break;
   }
 /* these events do not come from the platform. However,
@@ -338,6 +743,32 @@ uxdevice::platform::platform(const eventHandler &evtDispatcher) {
   and frees resources.
 */
 uxdevice::platform::~platform() {
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
+  if (m_renderThread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_frameMutex);
+      m_bRenderExit = true;
+    }
+    m_frameReady.notify_one();
+    {
+      std::lock_guard<std::mutex> lock(m_bufferMutex);
+    }
+    m_bufferAvailable.notify_one();
+    m_renderThread.join();
+  }
+  if (m_wakeFd >= 0)
+    close(m_wakeFd);
+#endif
+
+  // background rasterization refers to the connection.
+  for (auto &image : m_images) {
+    if (auto cache = image.lock()) {
+      cache->wait();
+      cache->notify(nullptr);
+      cache->bTracked = false;
+    }
+  }
+
 // Freetype can be used for windows or linux
 #ifdef USE_FREETYPE
   FTC_Manager_Done(m_cacheManager);
@@ -345,10 +776,11 @@ uxdevice::platform::~platform() {
 #endif
 
 #if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
-  xcb_shm_detach(m_connection, m_info.shmseg);
-  shmdt(m_info.shmaddr);
+  releaseBuffers();
+  for (auto xcbEvent : m_pendingEvents)
+    free(xcbEvent);
+  m_pendingEvents.clear();
 
-  xcb_free_pixmap(m_connection, m_pix);
   xcb_free_gc(m_connection, m_foreground);
   xcb_key_symbols_free(m_syms);
 
@@ -373,10 +805,6 @@ void uxdevice::platform::openWindow(const std::string &sWindowTitle,
   _w = width;
   _h = height;
 
-#if defined(USE_IMAGE_MAGICK)
-  m_offscreenImage.size(Magick::Geometry(_w,_h));
-#endif // defined
-
 #if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
   // this open provide interoperability between xcb and xwindows
   // this is used here because of the necessity of key mapping.
@@ -389,11 +817,17 @@ void uxdevice::platform::openWindow(const std::string &sWindowTitle,
   m_screen = xcb_setup_roots_iterator(xcb_get_setup(m_connection)).data;
   m_syms = xcb_key_symbols_alloc(m_connection);
 
+  // svg images are rasterized for the pixel density of the screen.
+  if (m_screen->width_in_millimeters)
+    m_deviceScale = m_screen->width_in_pixels * 25.4f /
+                    m_screen->width_in_millimeters / 96.0f;
+
   /* Create black (foreground) graphic context */
   m_window = m_screen->root;
   m_graphics = xcb_generate_id(m_connection);
+  // copies of obscured areas of the window report the areas not copied.
   uint32_t mask = XCB_GC_FOREGROUND | XCB_GC_GRAPHICS_EXPOSURES;
-  uint32_t values[2] = {m_screen->black_pixel, 0};
+  uint32_t values[2] = {m_screen->black_pixel, 1};
   xcb_create_gc(m_connection, m_graphics, m_window, mask, values);
 
   /* Create a window */
@@ -414,6 +848,26 @@ void uxdevice::platform::openWindow(const std::string &sWindowTitle,
                       XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, sWindowTitle.size(),
                       sWindowTitle.data());
 
+  // frames are paced by the vertical blank when the present extension is
+  // available.
+  const xcb_query_extension_reply_t *present =
+      xcb_get_extension_data(m_connection, &xcb_present_id);
+  xcb_present_query_version_reply_t *presentVersion =
+      present && present->present
+          ? xcb_present_query_version_reply(
+                m_connection, xcb_present_query_version(m_connection, 1, 0),
+                nullptr)
+          : nullptr;
+  if (presentVersion) {
+    m_presentOpcode = present->major_opcode;
+    xcb_present_select_input(m_connection, xcb_generate_id(m_connection),
+                             m_window, XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY);
+    m_bPresentPacing = true;
+    free(presentVersion);
+  }
+
+  m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
   // create offscreen bitmap
   resize(_w, _h);
   clear();
@@ -424,6 +878,10 @@ void uxdevice::platform::openWindow(const std::string &sWindowTitle,
   xcb_map_window(m_connection, m_window);
   xcb_flush(m_connection);
 
+#if defined(USE_RENDER_THREAD)
+  m_renderThread = std::thread(&uxdevice::platform::renderLoop, this);
+#endif
+
   return;
 
 #elif defined(USE_DIRECT_SCREEN_OUTPUT) && defined(_WIN64)
@@ -511,403 +969,1497 @@ void uxdevice::platform::closeWindow(void) {
 }
 
 /**
-\brief A reference to the internal display list is returned.
-*
-
+\brief begins a transaction with a copy of the published list. The
+transaction waits for those of other threads to be committed.
 */
-std::vector<displayListType> &uxdevice::platform::data(void) { return (DL); }
+uxdevice::displayTransaction::displayTransaction(platform &_platform)
+    : m_platform(_platform), m_lock(_platform.m_transactionMutex),
+      m_list(*_platform.published()) {}
 
-#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(_WIN64)
+/**
+\brief publishes the edited list. The renderer draws it from the next
+frame, which is requested once the events received are handled.
+*/
+void uxdevice::displayTransaction::commit(void) {
+  m_platform.publish(std::make_shared<const displayList>(std::move(m_list)));
+  m_lock.unlock();
+}
 
 /**
 \internal
-\brief The default window message processor for the application.
-This is the version of the Microsoft Windows operating system.
-
+\brief replaces the published list and wakes the message loop so that the
+change is seen when it is made by another thread.
 */
-LRESULT CALLBACK uxdevice::platform::WndProc(HWND hwnd, UINT message,
-                                             WPARAM wParam, LPARAM lParam) {
-  LRESULT result = 0;
-  bool handled = false;
-  /** get the platform objext which is stored within the user data of the
-   window. this is necessary as the wndproc for the windows operating system
-   is called from an external library. The routine needs to be a static
-   implementation which is not directly locate within the class.
-  */
-  LONG_PTR lpUserData = GetWindowLongPtr(hwnd, GWLP_USERDATA);
-  platform *platformInstance = (platform *)lpUserData;
-  switch (message) {
-  case WM_SIZE:
-    platformInstance->dispatchEvent(event{eventType::resize,
-                                          static_cast<short>(LOWORD(lParam)),
-                                          static_cast<short>(HIWORD(lParam))});
-    result = 0;
-    handled = true;
-    break;
-  case WM_KEYDOWN: {
-    UINT scandCode = (lParam >> 8) & 0xFFFFFF00;
-    platformInstance->dispatchEvent(
-        event{eventType::keydown, (unsigned int)wParam});
-    handled = true;
-  } break;
-  case WM_KEYUP: {
-    UINT scandCode = (lParam >> 8) & 0xFFFFFF00;
-    platformInstance->dispatchEvent(
-        event{eventType::keyup, (unsigned int)wParam});
-    handled = true;
-  } break;
-  case WM_CHAR: {
-    // filter out some of the control keys that
-    // slip through such as the back and tab keys
-    if (wParam > 27) {
-      WCHAR tmp[2];
-      tmp[0] = wParam;
-      tmp[1] = 0x00;
-      char ch = wParam;
-      platformInstance->dispatchEvent(event{eventType::keypress, ch});
-      handled = true;
-    }
-  } break;
-  case WM_LBUTTONDOWN:
-    platformInstance->dispatchEvent(
-        event{eventType::mousedown, static_cast<short>(LOWORD(lParam)),
-              static_cast<short>(HIWORD(lParam)), 1});
-    handled = true;
-    break;
-  case WM_LBUTTONUP:
-    platformInstance->dispatchEvent(
-        event{eventType::mouseup, static_cast<short>(LOWORD(lParam)),
-              static_cast<short>(HIWORD(lParam)), 1});
-    handled = true;
-    break;
-  case WM_MBUTTONDOWN:
-    platformInstance->dispatchEvent(
-        event{eventType::mousedown, static_cast<short>(LOWORD(lParam)),
-              static_cast<short>(HIWORD(lParam)), 2});
-    handled = true;
-    break;
-  case WM_MBUTTONUP:
-    platformInstance->dispatchEvent(
-        event{eventType::mouseup, static_cast<short>(LOWORD(lParam)),
-              static_cast<short>(HIWORD(lParam)), 2});
-    handled = true;
-    break;
-  case WM_RBUTTONDOWN:
-    platformInstance->dispatchEvent(
-        event{eventType::mousedown, static_cast<short>(LOWORD(lParam)),
-              static_cast<short>(HIWORD(lParam)), 3});
-    handled = true;
-    break;
-  case WM_RBUTTONUP:
-    platformInstance->dispatchEvent(
-        event{eventType::mouseup, static_cast<short>(LOWORD(lParam)),
-              static_cast<short>(HIWORD(lParam)), 3});
-    handled = true;
-    break;
-  case WM_MOUSEMOVE:
-    platformInstance->dispatchEvent(event{eventType::mousemove,
-                                          static_cast<short>(LOWORD(lParam)),
-                                          static_cast<short>(HIWORD(lParam))});
-    result = 0;
-    handled = true;
-    break;
-  case WM_MOUSEWHEEL: {
-    platformInstance->dispatchEvent(event{
-        eventType::wheel, static_cast<short>(LOWORD(lParam)),
-        static_cast<short>(HIWORD(lParam)), GET_WHEEL_DELTA_WPARAM(wParam)});
-    handled = true;
-  } break;
-  case WM_DISPLAYCHANGE:
-    InvalidateRect(hwnd, NULL, FALSE);
-    result = 0;
-    handled = true;
-    break;
-  case WM_PAINT: {
-    PAINTSTRUCT ps;
-    HDC hdc = BeginPaint(hwnd, &ps);
-    platformInstance->dispatchEvent(event{eventType::paint});
-    EndPaint(hwnd, &ps);
-    ValidateRect(hwnd, NULL);
-    result = 0;
-    handled = true;
-  } break;
-  case WM_DESTROY:
-    PostQuitMessage(0);
-    result = 1;
-    handled = true;
-    break;
-  }
-  if (!handled)
-    result = DefWindowProc(hwnd, message, wParam, lParam);
-  return result;
+void uxdevice::platform::publish(std::shared_ptr<const displayList> list) {
+  std::atomic_store(&m_published, std::move(list));
+  wake();
 }
-#endif
 
 /**
 \internal
-\brief the routine handles the message processing for the specific
-operating system. The function is called from processEvents.
-
+\brief wakes the message loop from another thread.
 */
-void uxdevice::platform::messageLoop(void) {
+void uxdevice::platform::wake(void) {
 #if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
-  xcb_generic_event_t *xcbEvent;
-  bool bRequestResize = false;
-  short int newWidth;
-  short int newHeight;
+  if (m_wakeFd >= 0) {
+    uint64_t one = 1;
+    if (write(m_wakeFd, &one, sizeof(one)) < 0)
+      return;
+  }
+#endif
+}
 
-  while ((xcbEvent = xcb_wait_for_event(m_connection))) {
-    switch (xcbEvent->response_type & ~0x80) {
-    case XCB_MOTION_NOTIFY: {
-      xcb_motion_notify_event_t *motion = (xcb_motion_notify_event_t *)xcbEvent;
-      dispatchEvent(event{
-          eventType::mousemove,
-          motion->event_x,
-          motion->event_y,
-      });
-    } break;
-    case XCB_BUTTON_PRESS: {
-      xcb_button_press_event_t *bp = (xcb_button_press_event_t *)xcbEvent;
-      if (bp->detail == XCB_BUTTON_INDEX_4 ||
-          bp->detail == XCB_BUTTON_INDEX_5) {
-        dispatchEvent(event{eventType::wheel, bp->event_x, bp->event_y,
-                            bp->detail == XCB_BUTTON_INDEX_4 ? 1 : -1});
+/**
+\brief marks a node as changed so that the next frame draws it.
+*/
+void uxdevice::platform::dirty(std::size_t idx) {
+  displayTransaction t = transaction();
+  t->touch(idx);
+  t.commit();
+}
 
-      } else {
-        dispatchEvent(
-            event{eventType::mousedown, bp->event_x, bp->event_y, bp->detail});
-      }
-    } break;
-    case XCB_BUTTON_RELEASE: {
-      xcb_button_release_event_t *br = (xcb_button_release_event_t *)xcbEvent;
-      // ignore button 4 and 5 which are wheel events.
-      if (br->detail != XCB_BUTTON_INDEX_4 && br->detail != XCB_BUTTON_INDEX_5)
-        dispatchEvent(
-            event{eventType::mouseup, br->event_x, br->event_y, br->detail});
-    } break;
-    case XCB_KEY_PRESS: {
-      xcb_key_press_event_t *kp = (xcb_key_press_event_t *)xcbEvent;
-      xcb_keysym_t sym = xcb_key_press_lookup_keysym(m_syms, kp, 0);
-      if (sym < 0x99) {
-        XKeyEvent keyEvent;
-        keyEvent.display = m_xdisplay;
-        keyEvent.keycode = kp->detail;
-        keyEvent.state = kp->state;
-        std::array<char, 16> buf{};
-        if (XLookupString(&keyEvent, buf.data(), buf.size(), nullptr, nullptr))
-          dispatchEvent(event{eventType::keypress, (char)buf[0]});
-      } else {
-        dispatchEvent(event{eventType::keydown, sym});
-      }
-    } break;
-    case XCB_KEY_RELEASE: {
-      xcb_key_release_event_t *kr = (xcb_key_release_event_t *)xcbEvent;
-      xcb_keysym_t sym = xcb_key_press_lookup_keysym(m_syms, kr, 0);
-      dispatchEvent(event{eventType::keyup, sym});
-    } break;
-    case XCB_EXPOSE: {
-      if (bRequestResize) {
-        dispatchEvent(event{eventType::resize, newWidth, newHeight});
-        bRequestResize = false;
-      }
-      dispatchEvent(event{eventType::paint});
-    } break;
-    case XCB_CONFIGURE_NOTIFY: {
-      const xcb_configure_notify_event_t *cfgEvent =
-          (const xcb_configure_notify_event_t *)xcbEvent;
-      if (cfgEvent->window == m_window) {
-        newWidth = cfgEvent->width;
-        newHeight = cfgEvent->height;
-        if ((newWidth != _w || newHeight != _h) && (newWidth > 0) &&
-            (newHeight > 0)) {
-          bRequestResize = true;
-        }
-      }
-    }
-    }
-    free(xcbEvent);
-  }
-#elif defined(USE_DIRECT_SCREEN_OUTPUT) && defined(_WIN64)
-  MSG msg;
-  while (GetMessage(&msg, NULL, 0, 0)) {
-    TranslateMessage(&msg);
-    DispatchMessage(&msg);
-  }
-#endif
+/**
+\brief returns the generation of the last write of the node or of the
+pooled value it refers to.
+*/
+std::uint64_t uxdevice::displayList::generation(const std::size_t idx) const {
+  const displayListType &n = m_nodes[idx];
+  std::uint64_t g = std::max(m_written[idx], m_assigned);
+
+  if (holds_alternative<stringData>(n))
+    g = std::max(g, m_stringWritten[get<stringData>(n).text]);
+  else if (holds_alternative<textFace>(n))
+    g = std::max(g, m_stringWritten[get<textFace>(n).face]);
+  else if (holds_alternative<imageSource>(n))
+    g = std::max(g, m_imageWritten[get<imageSource>(n).image]);
+
+  return g;
 }
-
-#if defined(USE_FREETYPE)
+
 /**
-\internal
-\brief The faceRequestor is a callback routine that provides
-creation of a face object. The parameter face_id is a pointer
-that is named as user information by the cache system.
+\brief returns the indexes of the nodes written after the generation since,
+in the order of the list.
+*/
+std::vector<std::size_t>
+uxdevice::displayList::changes(const std::uint64_t since) const {
+  std::vector<std::size_t> ret;
+  if (since == m_generation)
+    return ret;
 
-\param FTC_FaceID face_id the user generated index
-\param FT_Library library handle to the free type library
-\param FT_Pointer request_data unused
-\param FT_Face *aface the newly ycreated fash object.
+  for (std::size_t idx = 0; idx < m_nodes.size(); idx++)
+    if (generation(idx) > since)
+      ret.push_back(idx);
+
+  return ret;
+}
+
+/**
+\brief reserves storage for a number of nodes and pooled strings.
 */
-FT_Error uxdevice::platform::faceRequestor(FTC_FaceID face_id,
-                                           FT_Library library,
-                                           FT_Pointer request_data,
-                                           FT_Face *aface) {
-  FT_Error error;
-  faceCacheStruct *fID = static_cast<faceCacheStruct *>(face_id);
-  error = FT_New_Face(library, fID->filePath.data(), 0, aface);
+void uxdevice::displayList::reserve(const std::size_t nodes,
+                                    const std::size_t strings) {
+  m_nodes.reserve(nodes);
+  m_written.reserve(nodes);
+  m_strings.reserve(strings);
+  m_stringWritten.reserve(strings);
+}
 
-  // we want to use unicode
-  error = FT_Select_Charmap(*aface, FT_ENCODING_UNICODE);
+/**
+\brief returns a rotation about the origin, clockwise on the screen for
+positive angles.
+*/
+affine uxdevice::affine::rotation(const double radians) {
+  const double c = std::cos(radians);
+  const double s = std::sin(radians);
+  return affine{c, s, -s, c, 0.0, 0.0};
+}
 
-  return error;
-}
-#endif
+/**
+\brief returns the transform that applies o and then this one.
+*/
+affine uxdevice::affine::operator*(const affine &o) const {
+  return affine{xx * o.xx + xy * o.yx,       yx * o.xx + yy * o.yx,
+                xx * o.xy + xy * o.yy,       yx * o.xy + yy * o.yy,
+                xx * o.x0 + xy * o.y0 + x0, yx * o.x0 + yy * o.y0 + y0};
+}
 
 /**
-\internal
-\brief The function provides the building and location of a textFace name
-The function independently works on linux vs. windows. The linux is much
-more advanced in that it uses the fontconfig api. This api provides for
-family matching as a browser would incorporate. Whereas the windows portion
-uses the registry access and simply compares a string.
+\brief returns the transform that undoes this one. A transform which
+collapses the plane has no inverse, std::invalid_argument is thrown.
+*/
+affine uxdevice::affine::inverse(void) const {
+  const double det = xx * yy - xy * yx;
+  if (det == 0.0)
+    throw std::invalid_argument("The transform has no inverse.");
+  const double ixx = yy / det;
+  const double iyx = -yx / det;
+  const double ixy = -xy / det;
+  const double iyy = xx / det;
+  return affine{ixx, iyx, ixy, iyy, -(ixx * x0 + ixy * y0),
+                -(iyx * x0 + iyy * y0)};
+}
 
-The function comes from the following source:
-https://stackoverflow.com/questions/10542832/how-to-use-fontconfig-to-get-font-list-c-c
-https://stackoverflow.com/questions/3954223/platform-independent-way-to-get-font-directory
+/**
+\brief returns the bounds of the rectangle r once transformed, widened to
+whole pixels. A translation by whole pixels only moves r.
+*/
+rectangle uxdevice::affine::map(const rectangle &r) const {
+  // the bounds are kept within the range of the coordinates.
+  auto clamp = [](const double v) {
+    return static_cast<int>(std::max(std::min(v, static_cast<double>(INT_MAX)),
+                                     static_cast<double>(INT_MIN)));
+  };
+
+  if (isTranslation())
+    return rectangle(clamp(r.x1 + x0), clamp(r.y1 + y0), clamp(r.x2 + x0),
+                     clamp(r.y2 + y0));
+
+  const double xs[4] = {static_cast<double>(r.x1), static_cast<double>(r.x2),
+                        static_cast<double>(r.x1), static_cast<double>(r.x2)};
+  const double ys[4] = {static_cast<double>(r.y1), static_cast<double>(r.y1),
+                        static_cast<double>(r.y2), static_cast<double>(r.y2)};
+  double minX = std::numeric_limits<double>::max();
+  double minY = minX;
+  double maxX = std::numeric_limits<double>::lowest();
+  double maxY = maxX;
+  for (int i = 0; i < 4; i++) {
+    const double x = xx * xs[i] + xy * ys[i] + x0;
+    const double y = yx * xs[i] + yy * ys[i] + y0;
+    minX = std::min(minX, x);
+    minY = std::min(minY, y);
+    maxX = std::max(maxX, x);
+    maxY = std::max(maxY, y);
+  }
 
-\param sTextFace
+  return rectangle(clamp(std::floor(minX)), clamp(std::floor(minY)),
+                   clamp(std::ceil(maxX)), clamp(std::ceil(maxY)));
+}
 
-*/
-
-#if defined(USE_FREETYPE)
+/**
+\brief reserves storage for a number of nodes and strings in the list.
+*/
+displayBuilder &uxdevice::displayBuilder::reserve(const std::size_t nodes,
+                                                  const std::size_t strings) {
+  m_list.reserve(m_list.size() + nodes, strings);
+  return *this;
+}
 
-std::string uxdevice::platform::getFontFilename(const std::string &sTextFace) {
-  std::string fontFileReturn;
+/**
+\brief selects the face. The name is added to the string pool once.
+*/
+displayBuilder &uxdevice::displayBuilder::face(const std::string &name,
+                                               const int pointSize) {
+  auto it = m_faces.find(name);
+  if (it == m_faces.end())
+    it = m_faces.emplace(name, m_list.addString(name)).first;
+
+  if (!m_face || m_face->face != it->second || m_face->pointSize != pointSize)
+    emplace<textFace>(it->second, pointSize);
+  return *this;
+}
 
-#if defined(__linux__)
+/**
+\brief selects the color of the text.
+*/
+displayBuilder &uxdevice::displayBuilder::color(const unsigned int c) {
+  if (!m_color || *m_color != c)
+    emplace<textColor>(c);
+  return *this;
+}
 
-  FcConfig *config = FcInitLoadConfigAndFonts();
+/**
+\brief selects the alignment of the text.
+*/
+displayBuilder &uxdevice::displayBuilder::alignment(const char a) {
+  if (!m_alignment || *m_alignment != a)
+    emplace<textAlignment>(a);
+  return *this;
+}
 
-  // configure the search pattern,
-  // assume "name" is a std::string with the desired font name in it
-  FcPattern *pat = FcNameParse((const FcChar8 *)(sTextFace.c_str()));
-  FcConfigSubstitute(config, pat, FcMatchPattern);
-  FcDefaultSubstitute(pat);
+/**
+\brief sets the area of the following items.
+*/
+displayBuilder &uxdevice::displayBuilder::area(const rectangle &r) {
+  emplace<targetArea>(r);
+  return *this;
+}
 
-  // find the font
-  FcResult ret;
-  FcPattern *font = FcFontMatch(config, pat, &ret);
-  if (font) {
-    FcChar8 *file = NULL;
-    if (FcPatternGetString(font, FC_FILE, 0, &file) == FcResultMatch) {
-      // save the file to another std::string
-      fontFileReturn = (char *)file;
-    }
-    FcPatternDestroy(font);
-  }
+/**
+\brief names the next item for the comparison of lists.
+*/
+displayBuilder &uxdevice::displayBuilder::key(const std::uint64_t k) {
+  emplace<itemKey>(k);
+  return *this;
+}
 
-  FcPatternDestroy(pat);
+/**
+\brief limits the following items to r, within the clip in effect.
+*/
+displayBuilder &uxdevice::displayBuilder::pushClip(const rectangle &r) {
+  emplace<uxdevice::pushClip>(r);
+  return *this;
+}
 
-#elif defined(_WIN64)
+/**
+\brief ends the clip pushed last.
+*/
+displayBuilder &uxdevice::displayBuilder::popClip(void) {
+  emplace<uxdevice::popClip>();
+  return *this;
+}
 
-  wstring subKey = L"Software\\Microsoft\\Windows NT\\CurrentVersion\\Fonts";
+/**
+\brief transforms the following items by t, within the transform in
+effect.
+*/
+displayBuilder &uxdevice::displayBuilder::pushTransform(const affine &t) {
+  emplace<uxdevice::pushTransform>(t);
+  return *this;
+}
 
-  HKEY regKey = 0;
-  LONG ret;
-  wstring wsName;
-  DWORD dwNameSize;
-  vector<BYTE> vValue;
-  DWORD dwValueSize;
-  DWORD dwType = 0;
-  DWORD index = 0;
-  wstring wsSearch;
+/**
+\brief ends the transform pushed last.
+*/
+displayBuilder &uxdevice::displayBuilder::popTransform(void) {
+  emplace<uxdevice::popTransform>();
+  return *this;
+}
 
-  // convert input string to a multibyte wstring.
-  int wsSize =
-      MultiByteToWideChar(CP_ACP, MB_ERR_INVALID_CHARS, sTextFace.data(),
-                          sTextFace.size(), wsSearch.data(), 0);
-  wsSearch.resize(wsSize);
-  MultiByteToWideChar(CP_ACP, MB_ERR_INVALID_CHARS, sTextFace.data(),
-                      sTextFace.size(), wsSearch.data(), wsSize);
+/**
+\brief adds the string to the pool and draws all of it.
+*/
+displayBuilder &uxdevice::displayBuilder::text(std::string s,
+                                               const bool bWordBreaks) {
+  std::size_t length = s.size();
+  emplace<stringData>(m_list.addString(std::move(s)), bWordBreaks);
+  emplace<drawText>(0, length);
+  return *this;
+}
 
-  // open the registry key
-  ret = RegOpenKeyExW(HKEY_LOCAL_MACHINE, subKey.c_str(), 0, KEY_READ, &regKey);
-  if (ret != ERROR_SUCCESS) {
-    string errorCode;
-    errorCode = "Could not open windows registry (" + to_string(ret) + ")";
-    throw std::runtime_error(errorCode);
-  }
+/**
+\brief adds the image to the pool and draws it.
+*/
+displayBuilder &
+uxdevice::displayBuilder::image(imageData image,
+                                const std::optional<imageFit> fit,
+                                const std::optional<rectangle> src) {
+  emplace<imageSource>(m_list.addImage(std::move(image)));
+  emplace<drawImage>(src, fit);
+  return *this;
+}
 
-  // get the number of entries
-  DWORD valueCount;
-  DWORD maxValueNameLen;
-  DWORD maxValueLen;
+/**
+\brief removes the nodes and the pooled values they refer to. The storage
+is kept for the list built next.
+*/
+void uxdevice::displayList::clear(void) {
+  m_nodes.clear();
+  m_strings.clear();
+  m_images.clear();
+  m_handlers.clear();
+  m_written.clear();
+  m_stringWritten.clear();
+  m_imageWritten.clear();
+  m_mapping.reset();
+  m_generation++;
+}
 
-  // get the numer of items and the maximum lengths.
-  ret = RegQueryInfoKey(regKey, nullptr, nullptr, nullptr, nullptr, nullptr,
-                        nullptr, &valueCount, &maxValueNameLen, &maxValueLen,
-                        nullptr, nullptr);
-  if (ret != ERROR_SUCCESS) {
-    string errorCode;
-    errorCode = "Could not open windows registry (" + to_string(ret) + ")";
-    throw std::runtime_error(errorCode);
+/**
+\brief exchanges the contents of two lists without copying them.
+*/
+void uxdevice::displayList::swap(displayList &other) {
+  m_nodes.swap(other.m_nodes);
+  m_strings.swap(other.m_strings);
+  m_images.swap(other.m_images);
+  m_handlers.swap(other.m_handlers);
+  m_written.swap(other.m_written);
+  m_stringWritten.swap(other.m_stringWritten);
+  m_imageWritten.swap(other.m_imageWritten);
+  m_mapping.swap(other.m_mapping);
+  std::swap(m_generation, other.m_generation);
+  std::swap(m_assigned, other.m_assigned);
+}
+
+/**
+\brief replaces the contents of the list. The generations of the other
+list, such as one that was loaded, need not follow those of the list it
+replaces. The generation is advanced past both and every node counts as
+written at it, so the renderer sees the whole list as changed.
+*/
+displayList &uxdevice::displayList::operator=(displayList other) {
+  const std::uint64_t replaced = m_generation;
+  swap(other);
+  m_generation = std::max(m_generation, replaced) + 1;
+  m_assigned = m_generation;
+  return *this;
+}
+
+/**
+\internal
+\brief The display list file holds the nodes of a list as fixed size
+records. They are followed by one table entry per pooled string and per
+image file name, then by the characters the entries refer to. Nodes name
+strings and images by their index, as within the list. The type of a
+record is the index of the node within displayListType, so new node types
+are added at its end. Event handlers are code, only their count is stored
+and a loaded list holds empty handlers. Values are stored in the native
+byte order of the machine which wrote the file.
+*/
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t nodes;
+  uint32_t strings;
+  uint32_t images;
+  uint32_t handlers;
+  uint64_t characters;
+} displayListHeader;
+
+typedef struct {
+  uint32_t type;
+  uint32_t flags;
+  uint64_t value[2];
+  int32_t area[4];
+} displayListRecord;
+
+typedef struct {
+  uint64_t offset;
+  uint64_t length;
+} displayListString;
+
+static const char displayListMagic[4] = {'U', 'X', 'D', 'L'};
+static const uint32_t displayListVersion = 1;
+static const uint32_t displayListWordBreaks = 1;
+static const uint32_t displayListHasSource = 2;
+static const uint32_t displayListHasFit = 4;
+
+/**
+\internal
+\brief the index of the node type T within the variant V.
+*/
+template <typename T, typename V> struct nodeIndex;
+template <typename T, typename... Ts>
+struct nodeIndex<T, std::variant<Ts...>> {
+  static constexpr std::size_t value = [] {
+    std::size_t i = 0;
+    ((std::is_same_v<T, Ts> ? false : (++i, true)) && ...);
+    return i;
+  }();
+};
+template <typename T>
+static constexpr std::size_t nodeType = nodeIndex<T, displayListType>::value;
+
+/**
+\brief writes the list in the display list file format. Images are stored
+by their file name, an image supplied as pixels throws.
+*/
+void uxdevice::displayList::save(const std::string &sFileName) const {
+  std::string info = "Cannot write the display list: ";
+  info += sFileName;
+
+  displayListHeader header;
+  memcpy(header.magic, displayListMagic, sizeof(displayListMagic));
+  header.version = displayListVersion;
+  header.nodes = m_nodes.size();
+  header.strings = m_strings.size();
+  header.images = m_images.size();
+  header.handlers = m_handlers.size();
+  header.characters = 0;
+
+  // the strings and image file names share the characters.
+  vector<displayListString> table;
+  vector<std::string_view> values;
+  auto entry = [&](std::string_view s) {
+    table.push_back(displayListString{header.characters, s.size()});
+    values.push_back(s);
+    header.characters += s.size();
+  };
+  for (auto &s : m_strings)
+    entry(s.view());
+  for (auto &image : m_images) {
+    if (!image.fileName)
+      throw std::invalid_argument(info);
+    entry(*image.fileName);
   }
 
-  // resize for space and clear
-  maxValueLen++;
-  maxValueNameLen++;
-  wsName.resize(maxValueNameLen);
-  vValue.resize(maxValueLen);
-  bool bFound = false;
+  vector<displayListRecord> records(m_nodes.size());
+  auto record = records.begin();
+  for (auto &n : m_nodes) {
+    displayListRecord &r = *record++;
+    memset(&r, 0, sizeof(r));
+    r.type = n.index();
 
-  // look for a match
-  for (DWORD index = 0; index < valueCount; index++) {
+    if (holds_alternative<stringData>(n)) {
+      r.value[0] = get<stringData>(n).text;
+      r.flags = get<stringData>(n).bWordBreaks ? displayListWordBreaks : 0;
 
-    // get registry value
-    dwNameSize = maxValueNameLen;
-    dwValueSize = maxValueLen;
-    ret = RegEnumValueW(regKey, index, wsName.data(), &dwNameSize, NULL,
-                        &dwType, vValue.data(), &dwValueSize);
-    if (ret != ERROR_SUCCESS) {
-      string errorCode;
-      errorCode = "Could not open windows registry (" + to_string(ret) + ")";
-      throw std::runtime_error(errorCode);
-    }
+    } else if (holds_alternative<imageSource>(n)) {
+      r.value[0] = get<imageSource>(n).image;
 
-    // match name or file names
-    if (_wcsnicmp(wsName.c_str(), wsSearch.c_str(), wsSearch.size()) == 0) {
-      bFound = true;
-      break;
+    } else if (holds_alternative<textFace>(n)) {
+      r.value[0] = get<textFace>(n).face;
+      r.area[0] = get<textFace>(n).pointSize;
+
+    } else if (holds_alternative<textColor>(n)) {
+      r.value[0] = get<textColor>(n).data;
+
+    } else if (holds_alternative<textAlignment>(n)) {
+      r.value[0] = static_cast<unsigned char>(get<textAlignment>(n).data);
+
+    } else if (holds_alternative<targetArea>(n)) {
+      const rectangle &a = get<targetArea>(n).data;
+      r.area[0] = a.x1;
+      r.area[1] = a.y1;
+      r.area[2] = a.x2;
+      r.area[3] = a.y2;
+
+    } else if (holds_alternative<catchEvent>(n)) {
+      r.value[0] = get<catchEvent>(n).handler;
+
+    } else if (holds_alternative<drawText>(n)) {
+      r.value[0] = get<drawText>(n).beginIndex;
+      r.value[1] = get<drawText>(n).endIndex;
+
+    } else if (holds_alternative<itemKey>(n)) {
+      r.value[0] = get<itemKey>(n).key;
+
+    } else if (holds_alternative<pushClip>(n)) {
+      const rectangle &a = get<pushClip>(n).data;
+      r.area[0] = a.x1;
+      r.area[1] = a.y1;
+      r.area[2] = a.x2;
+      r.area[3] = a.y2;
+
+    } else if (holds_alternative<pushTransform>(n)) {
+      // the offsets are kept exact, the linear part as floats.
+      const affine &t = get<pushTransform>(n).data;
+      const float linear[4] = {static_cast<float>(t.xx),
+                               static_cast<float>(t.yx),
+                               static_cast<float>(t.xy),
+                               static_cast<float>(t.yy)};
+      memcpy(&r.value[0], &t.x0, sizeof(double));
+      memcpy(&r.value[1], &t.y0, sizeof(double));
+      memcpy(r.area, linear, sizeof(linear));
+
+    } else if (holds_alternative<drawImage>(n)) {
+      const drawImage &di = get<drawImage>(n);
+      if (di.src) {
+        r.flags |= displayListHasSource;
+        r.area[0] = di.src->x1;
+        r.area[1] = di.src->y1;
+        r.area[2] = di.src->x2;
+        r.area[3] = di.src->y2;
+      }
+      if (di.fit) {
+        r.flags |= displayListHasFit;
+        r.value[0] = static_cast<uint64_t>(*di.fit);
+      }
     }
   }
 
-  // close the registry key
-  RegCloseKey(regKey);
+  ofstream file(sFileName, ios::binary | ios::trunc);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(records.data()),
+             records.size() * sizeof(displayListRecord));
+  file.write(reinterpret_cast<const char *>(table.data()),
+             table.size() * sizeof(displayListString));
+  for (auto &s : values)
+    file.write(s.data(), s.size());
 
-  /**
-    Some font filenames within the registry have the path built in
-    while most windows fonts do not. This provides the full path.
-    For simplicity, check the second and third characters of the
-    file name to determine if it has a drive specifier.
-  */
-  LPWSTR lpwData = reinterpret_cast<LPWSTR>(vValue.data());
-  wstring wsfontFileReturn;
+  if (!file)
+    throw std::invalid_argument(info);
+}
 
-  // if (!bFound)
-  // wcscpy_s(lpwData, L"arial.ttf");
+/**
+\brief loads a display list file. The file is mapped and the strings of the
+list refer to the mapping, which is released with the last copy of the
+list. Every reference of a node is validated, a file which fails throws.
+*/
+displayList uxdevice::displayList::load(const std::string &sFileName) {
+  std::string info = "Invalid display list file: ";
+  info += sFileName;
 
-  if (_wcsnicmp(lpwData + 1, L":\\", 2) == 0) {
-    wsfontFileReturn = lpwData;
+  std::shared_ptr<const void> storage;
+  std::size_t length = 0;
 
-  } else {
-    wsfontFileReturn.resize(MAX_PATH);
-    int lLen = GetSystemWindowsDirectoryW(wsfontFileReturn.data(), MAX_PATH);
-    wsfontFileReturn.resize(lLen);
-    wsfontFileReturn.append(L"\\Fonts\\");
-    wsfontFileReturn.append(lpwData);
+#if defined(__linux__)
+  int fd = open(sFileName.data(), O_RDONLY);
+  struct stat fileInfo;
+  if (fd < 0 || fstat(fd, &fileInfo) != 0 || fileInfo.st_size == 0) {
+    if (fd >= 0)
+      close(fd);
+    throw std::invalid_argument(info);
   }
 
-  // convert the widestring to an utf8 or default character representation
+  length = fileInfo.st_size;
+  void *address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED)
+    throw std::invalid_argument(info);
+  storage = std::shared_ptr<const void>(address, [length](const void *p) {
+    munmap(const_cast<void *>(p), length);
+  });
+
+#else
+  // where files are not mapped, the contents are read.
+  ifstream file(sFileName, ios::binary | ios::ate);
+  if (!file)
+    throw std::invalid_argument(info);
+  length = file.tellg();
+  auto buffer = make_shared<vector<char>>(length);
+  file.seekg(0);
+  file.read(buffer->data(), length);
+  if (!file)
+    throw std::invalid_argument(info);
+  storage = std::shared_ptr<const void>(buffer, buffer->data());
+#endif
+
+  // validate the header and the tables against the file size.
+  const char *base = static_cast<const char *>(storage.get());
+  displayListHeader header;
+  if (length < sizeof(header))
+    throw std::invalid_argument(info);
+  memcpy(&header, base, sizeof(header));
+
+  const uint64_t entries = uint64_t(header.strings) + header.images;
+  const uint64_t tableAt =
+      sizeof(header) + uint64_t(header.nodes) * sizeof(displayListRecord);
+  const uint64_t charactersAt = tableAt + entries * sizeof(displayListString);
+  if (memcmp(header.magic, displayListMagic, sizeof(displayListMagic)) != 0 ||
+      header.version != displayListVersion || charactersAt > length ||
+      header.characters != length - charactersAt)
+    throw std::invalid_argument(info);
+
+  const displayListRecord *records =
+      reinterpret_cast<const displayListRecord *>(base + sizeof(header));
+  const displayListString *table =
+      reinterpret_cast<const displayListString *>(base + tableAt);
+  const char *characters = base + charactersAt;
+  for (uint64_t i = 0; i < entries; i++)
+    if (table[i].offset > header.characters ||
+        table[i].length > header.characters - table[i].offset)
+      throw std::invalid_argument(info);
+
+  displayList list;
+  list.m_mapping = storage;
+  list.reserve(header.nodes, header.strings);
+  for (uint32_t i = 0; i < header.strings; i++) {
+    list.m_strings.push_back(pooledString::mapped(
+        std::string_view(characters + table[i].offset, table[i].length)));
+    list.m_stringWritten.push_back(++list.m_generation);
+  }
+  for (uint32_t i = header.strings; i < entries; i++)
+    list.addImage(imageData(make_shared<std::string>(
+        characters + table[i].offset, table[i].length)));
+  for (uint32_t i = 0; i < header.handlers; i++)
+    list.addHandler(eventHandler());
+
+  // a text range is checked against the string in effect, a popClip or a
+  // popTransform against those pushed.
+  uint64_t textLength = 0;
+  uint32_t clips = 0;
+  uint32_t transforms = 0;
+  for (uint32_t i = 0; i < header.nodes; i++) {
+    const displayListRecord &r = records[i];
+    const rectangle area(r.area[0], r.area[1], r.area[2], r.area[3]);
+
+    switch (r.type) {
+    case nodeType<stringData>:
+      if (r.value[0] >= header.strings)
+        throw std::invalid_argument(info);
+      textLength = table[r.value[0]].length;
+      list.emplace_back<stringData>(static_cast<uint32_t>(r.value[0]),
+                                    (r.flags & displayListWordBreaks) != 0);
+      break;
+    case nodeType<imageSource>:
+      if (r.value[0] >= header.images)
+        throw std::invalid_argument(info);
+      list.emplace_back<imageSource>(static_cast<uint32_t>(r.value[0]));
+      break;
+    case nodeType<textFace>:
+      if (r.value[0] >= header.strings)
+        throw std::invalid_argument(info);
+      list.emplace_back<textFace>(static_cast<uint32_t>(r.value[0]),
+                                  r.area[0]);
+      break;
+    case nodeType<textColor>:
+      list.emplace_back<textColor>(static_cast<unsigned int>(r.value[0]));
+      break;
+    case nodeType<textAlignment>:
+      list.emplace_back<textAlignment>(static_cast<char>(r.value[0]));
+      break;
+    case nodeType<targetArea>:
+      list.emplace_back<targetArea>(area);
+      break;
+    case nodeType<catchEvent>:
+      if (r.value[0] >= header.handlers)
+        throw std::invalid_argument(info);
+      list.emplace_back<catchEvent>(static_cast<uint32_t>(r.value[0]));
+      break;
+    case nodeType<drawText>:
+      if (r.value[0] > r.value[1] || r.value[1] > textLength)
+        throw std::invalid_argument(info);
+      list.emplace_back<drawText>(r.value[0], r.value[1]);
+      break;
+    case nodeType<drawImage>: {
+      if ((r.flags & displayListHasFit) &&
+          r.value[0] > static_cast<uint64_t>(imageFit::stretch))
+        throw std::invalid_argument(info);
+      drawImage di;
+      if (r.flags & displayListHasSource)
+        di.src = area;
+      if (r.flags & displayListHasFit)
+        di.fit = static_cast<imageFit>(r.value[0]);
+      list.push_back(di);
+    } break;
+    case nodeType<itemKey>:
+      list.emplace_back<itemKey>(r.value[0]);
+      break;
+    case nodeType<pushClip>:
+      clips++;
+      list.emplace_back<pushClip>(area);
+      break;
+    case nodeType<popClip>:
+      if (clips == 0)
+        throw std::invalid_argument(info);
+      clips--;
+      list.emplace_back<popClip>();
+      break;
+    case nodeType<pushTransform>: {
+      float linear[4];
+      affine t;
+      memcpy(linear, r.area, sizeof(linear));
+      memcpy(&t.x0, &r.value[0], sizeof(double));
+      memcpy(&t.y0, &r.value[1], sizeof(double));
+      t.xx = linear[0];
+      t.yx = linear[1];
+      t.xy = linear[2];
+      t.yy = linear[3];
+      if (!std::isfinite(t.x0) || !std::isfinite(t.y0) ||
+          !std::isfinite(t.xx * t.yy - t.xy * t.yx))
+        throw std::invalid_argument(info);
+      transforms++;
+      list.emplace_back<pushTransform>(t);
+    } break;
+    case nodeType<popTransform>:
+      if (transforms == 0)
+        throw std::invalid_argument(info);
+      transforms--;
+      list.emplace_back<popTransform>();
+      break;
+    default:
+      throw std::invalid_argument(info);
+    }
+  }
+
+  return list;
+}
+
+/**
+\internal
+\brief an item of a display list, used to compare lists. The fingerprint
+combines the values of the face, color and alignment in effect for a text,
+or the image, and what places the item.
+*/
+typedef struct {
+  std::size_t node;
+  bool bKeyed;
+  std::uint64_t key;
+  rectangle bounds;
+  std::uint64_t fingerprint;
+  bool bTouched;
+} displayItem;
+
+/**
+\internal
+\brief combines a value into a hash.
+*/
+static inline std::uint64_t hashMix(const std::uint64_t h,
+                                    const std::uint64_t v) {
+  return (h ^ (v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2))) *
+         0x100000001b3ull;
+}
+
+/**
+\internal
+\brief lists the items of a display list in the order they are drawn.
+Items before the first targetArea are not clipped, their bounds are the
+whole surface. The bounds of an item are its area mapped by the transform in
+effect and cut by the clips pushed, while its area and transform are part of
+the fingerprint since they place what is drawn. An item is touched when its
+draw node, or a node in effect for it, was written after the generation
+since, so that a node marked dirty is drawn even when nothing differs.
+*/
+static std::vector<displayItem> displayItems(const displayList &list,
+                                             const std::uint64_t since) {
+  std::vector<displayItem> items;
+  rectangle area(0, 0, INT_MAX, INT_MAX);
+  std::vector<rectangle> clips(1, area);
+  std::vector<affine> transforms(1);
+  std::string_view text;
+  std::uint64_t face = 0;
+  unsigned int color = 0;
+  char alignment = 'l';
+  std::uint64_t image = 0;
+  std::optional<std::uint64_t> key;
+  std::size_t idx = 0;
+
+  // the generations of the nodes in effect, kept only when the list was
+  // written after since.
+  const bool bWritten = list.generation() > since;
+  enum { textSlot, imageSlot, faceSlot, colorSlot, alignmentSlot, areaSlot,
+         keySlot, slots };
+  std::array<std::uint64_t, slots> written{};
+  std::vector<std::uint64_t> clipWritten(1, 0);
+  std::vector<std::uint64_t> transformWritten(1, 0);
+
+  for (auto &n : list) {
+    const std::uint64_t g = bWritten ? list.generation(idx) : 0;
+    if (holds_alternative<stringData>(n)) {
+      text = list.string(get<stringData>(n).text);
+      written[textSlot] = g;
+
+    } else if (holds_alternative<imageSource>(n)) {
+      const imageData &data = list.image(get<imageSource>(n).image);
+      image = hashMix(reinterpret_cast<std::uintptr_t>(data.cache.get()),
+                      reinterpret_cast<std::uintptr_t>(data.tiles.get()));
+      written[imageSlot] = g;
+
+    } else if (holds_alternative<textFace>(n)) {
+      const textFace &f = get<textFace>(n);
+      face = hashMix(std::hash<std::string_view>()(list.string(f.face)),
+                     f.pointSize);
+      written[faceSlot] = g;
+
+    } else if (holds_alternative<textColor>(n)) {
+      color = get<textColor>(n).data;
+      written[colorSlot] = g;
+
+    } else if (holds_alternative<textAlignment>(n)) {
+      alignment = get<textAlignment>(n).data;
+      written[alignmentSlot] = g;
+
+    } else if (holds_alternative<targetArea>(n)) {
+      area = get<targetArea>(n).data;
+      written[areaSlot] = g;
+
+    } else if (holds_alternative<itemKey>(n)) {
+      key = get<itemKey>(n).key;
+      written[keySlot] = g;
+
+    } else if (holds_alternative<pushClip>(n)) {
+      clips.push_back(intersectRectangle(
+          clips.back(), transforms.back().map(get<pushClip>(n).data)));
+      clipWritten.push_back(
+          std::max({clipWritten.back(), transformWritten.back(), g}));
+
+    } else if (holds_alternative<popClip>(n)) {
+      if (clips.size() > 1) {
+        clips.pop_back();
+        clipWritten.pop_back();
+      }
+
+    } else if (holds_alternative<pushTransform>(n)) {
+      transforms.push_back(transforms.back() * get<pushTransform>(n).data);
+      transformWritten.push_back(std::max(transformWritten.back(), g));
+
+    } else if (holds_alternative<popTransform>(n)) {
+      if (transforms.size() > 1) {
+        transforms.pop_back();
+        transformWritten.pop_back();
+      }
+
+    } else if (holds_alternative<drawText>(n) ||
+               holds_alternative<drawImage>(n)) {
+      std::uint64_t h = hashMix(
+          hashMix(hashMix(hashMix(n.index(), area.x1), area.y1), area.x2),
+          area.y2);
+      const affine &t = transforms.back();
+      for (double v : {t.xx, t.yx, t.xy, t.yy, t.x0, t.y0})
+        h = hashMix(h, std::hash<double>()(v));
+      if (holds_alternative<drawText>(n)) {
+        // the text state in effect, not the nodes that led to it.
+        h = hashMix(hashMix(hashMix(h, face), color), alignment);
+        const drawText &dt = get<drawText>(n);
+        std::size_t end = std::min(dt.endIndex, text.size());
+        std::size_t begin = std::min(dt.beginIndex, end);
+        h = hashMix(h, std::hash<std::string_view>()(
+                           text.substr(begin, end - begin)));
+      } else {
+        const drawImage &di = get<drawImage>(n);
+        h = hashMix(h, image);
+        if (di.fit)
+          h = hashMix(h, static_cast<std::uint64_t>(*di.fit) + 1);
+        if (di.src)
+          h = hashMix(hashMix(hashMix(hashMix(h, di.src->x1), di.src->y1),
+                              di.src->x2),
+                      di.src->y2);
+      }
+      rectangle bounds =
+          intersectRectangle(transforms.back().map(area), clips.back());
+      if (bounds.x1 >= bounds.x2 || bounds.y1 >= bounds.y2)
+        bounds = rectangle(0, 0, 0, 0);
+      std::uint64_t last = std::max(
+          {g, written[areaSlot], written[keySlot], clipWritten.back(),
+           transformWritten.back()});
+      if (holds_alternative<drawText>(n))
+        last = std::max({last, written[textSlot], written[faceSlot],
+                         written[colorSlot], written[alignmentSlot]});
+      else
+        last = std::max(last, written[imageSlot]);
+      items.push_back(displayItem{idx, key.has_value(), key.value_or(0),
+                                  bounds, h, bWritten && last > since});
+      key.reset();
+    }
+    idx++;
+  }
+
+  return items;
+}
+
+/**
+\brief compares the items of two display lists.
+*/
+uxdevice::displayDiff::displayDiff(const displayList &before,
+                                   const displayList &after) {
+  std::vector<displayItem> oldItems =
+      displayItems(before, std::numeric_limits<std::uint64_t>::max());
+  std::vector<displayItem> newItems = displayItems(after, before.generation());
+  const rectangle none(0, 0, 0, 0);
+
+  auto same = [](const rectangle &a, const rectangle &b) {
+    return a.x1 == b.x1 && a.y1 == b.y1 && a.x2 == b.x2 && a.y2 == b.y2;
+  };
+
+  // keyed items are found by key, the others by their position among the
+  // items without a key.
+  std::unordered_map<std::uint64_t, std::size_t> keyed;
+  std::vector<std::size_t> unkeyed;
+  for (std::size_t i = 0; i < oldItems.size(); i++) {
+    if (oldItems[i].bKeyed)
+      keyed.emplace(oldItems[i].key, i);
+    else
+      unkeyed.push_back(i);
+  }
+
+  std::vector<bool> matched(oldItems.size(), false);
+  std::size_t nextUnkeyed = 0;
+  std::size_t lastKeyed = 0;
+  bool bAnyKeyed = false;
+
+  for (auto &item : newItems) {
+    std::optional<std::size_t> old;
+    bool bMoved = false;
+    if (item.bKeyed) {
+      auto it = keyed.find(item.key);
+      if (it != keyed.end() && !matched[it->second]) {
+        old = it->second;
+        // an item drawn before one it followed may now cover it.
+        bMoved = bAnyKeyed && *old < lastKeyed;
+        lastKeyed = *old;
+        bAnyKeyed = true;
+      }
+    } else if (nextUnkeyed < unkeyed.size()) {
+      old = unkeyed[nextUnkeyed++];
+    }
+
+    if (!old) {
+      changes.push_back(displayChange{changeType::inserted, 0, item.node,
+                                      none, item.bounds});
+      continue;
+    }
+
+    const displayItem &o = oldItems[*old];
+    matched[*old] = true;
+    if (bMoved || item.bTouched || o.fingerprint != item.fingerprint ||
+        !same(o.bounds, item.bounds))
+      changes.push_back(displayChange{changeType::changed, o.node, item.node,
+                                      o.bounds, item.bounds});
+  }
+
+  for (std::size_t i = 0; i < oldItems.size(); i++)
+    if (!matched[i])
+      changes.push_back(displayChange{changeType::removed, oldItems[i].node,
+                                      0, oldItems[i].bounds, none});
+}
+
+/**
+\brief returns the areas that must be drawn again, the old and new bounds
+of each change.
+*/
+std::vector<rectangle> uxdevice::displayDiff::damage(void) const {
+  std::vector<rectangle> ret;
+  for (auto &c : changes) {
+    if (c.type != changeType::inserted)
+      ret.push_back(c.oldBounds);
+    if (c.type != changeType::removed)
+      ret.push_back(c.newBounds);
+  }
+  return ret;
+}
+
+/**
+\brief states that the contents of area moved by dx, dy, for instance when
+a text view is scrolled by moving its targetArea. When this is the only
+change before the next frame, the pixels already drawn are moved and only
+the strips exposed by the move are drawn again. Writes of targetArea nodes
+or pushTransform nodes committed before the call are taken to be the move.
+scroll may be called by any thread, the move is posted to the message loop
+which requests a frame.
+*/
+void uxdevice::platform::scroll(const rectangle &area, const int dx,
+                                const int dy) {
+  {
+    std::lock_guard<std::mutex> lock(m_scrollMutex);
+
+    // moves of the same area are combined.
+    if (!m_postedScrolls.empty() &&
+        m_postedScrolls.back().area.x1 == area.x1 &&
+        m_postedScrolls.back().area.y1 == area.y1 &&
+        m_postedScrolls.back().area.x2 == area.x2 &&
+        m_postedScrolls.back().area.y2 == area.y2) {
+      m_postedScrolls.back().dx += dx;
+      m_postedScrolls.back().dy += dy;
+    } else {
+      m_postedScrolls.push_back(scrollMove{area, dx, dy});
+    }
+    m_postedGeneration = published()->generation();
+    m_bScrollPosted = true;
+  }
+
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
+  wake();
+#else
+  applyScrolls();
+#endif
+}
+
+/**
+\internal
+\brief moves the posted scrolls to m_scrolls, on the event thread. Nodes
+written up to the generation a scroll was posted with that are not
+targetArea or pushTransform nodes make the scene changed. Nodes written
+after it are seen by scrollOnly. A move whose list was drawn already is
+dropped.
+*/
+void uxdevice::platform::applyScrolls(void) {
+  if (!m_bScrollPosted)
+    return;
+
+  std::vector<scrollMove> posted;
+  std::uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(m_scrollMutex);
+    posted.swap(m_postedScrolls);
+    generation = m_postedGeneration;
+    m_bScrollPosted = false;
+  }
+
+  // a frame drawn since the move was committed already shows it.
+  if (generation <= m_drawnGeneration)
+    return;
+
+  for (auto &move : posted) {
+    if (!m_scrolls.empty() && m_scrolls.back().area.x1 == move.area.x1 &&
+        m_scrolls.back().area.y1 == move.area.y1 &&
+        m_scrolls.back().area.x2 == move.area.x2 &&
+        m_scrolls.back().area.y2 == move.area.y2) {
+      m_scrolls.back().dx += move.dx;
+      m_scrolls.back().dy += move.dy;
+    } else {
+      m_scrolls.push_back(move);
+    }
+  }
+
+  // changes of target areas written before the scroll are the move.
+  std::shared_ptr<const displayList> list = published();
+  for (auto idx :
+       list->changes(std::max(m_drawnGeneration, m_scrollGeneration)))
+    if (list->generation(idx) <= generation &&
+        !holds_alternative<targetArea>((*list)[idx]) &&
+        !holds_alternative<pushTransform>((*list)[idx]))
+      m_bSceneChanged = true;
+  m_scrollGeneration = std::max(m_scrollGeneration, generation);
+
+  requestFrame();
+}
+
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(_WIN64)
+
+/**
+\internal
+\brief The default window message processor for the application.
+This is the version of the Microsoft Windows operating system.
+
+*/
+LRESULT CALLBACK uxdevice::platform::WndProc(HWND hwnd, UINT message,
+                                             WPARAM wParam, LPARAM lParam) {
+  LRESULT result = 0;
+  bool handled = false;
+  /** get the platform objext which is stored within the user data of the
+   window. this is necessary as the wndproc for the windows operating system
+   is called from an external library. The routine needs to be a static
+   implementation which is not directly locate within the class.
+  */
+  LONG_PTR lpUserData = GetWindowLongPtr(hwnd, GWLP_USERDATA);
+  platform *platformInstance = (platform *)lpUserData;
+  switch (message) {
+  case WM_SIZE:
+    platformInstance->dispatchEvent(event{eventType::resize,
+                                          static_cast<short>(LOWORD(lParam)),
+                                          static_cast<short>(HIWORD(lParam))});
+    result = 0;
+    handled = true;
+    break;
+  case WM_KEYDOWN: {
+    UINT scandCode = (lParam >> 8) & 0xFFFFFF00;
+    platformInstance->dispatchEvent(
+        event{eventType::keydown, (unsigned int)wParam});
+    handled = true;
+  } break;
+  case WM_KEYUP: {
+    UINT scandCode = (lParam >> 8) & 0xFFFFFF00;
+    platformInstance->dispatchEvent(
+        event{eventType::keyup, (unsigned int)wParam});
+    handled = true;
+  } break;
+  case WM_CHAR: {
+    // filter out some of the control keys that
+    // slip through such as the back and tab keys
+    if (wParam > 27) {
+      WCHAR tmp[2];
+      tmp[0] = wParam;
+      tmp[1] = 0x00;
+      char ch = wParam;
+      platformInstance->dispatchEvent(event{eventType::keypress, ch});
+      handled = true;
+    }
+  } break;
+  case WM_LBUTTONDOWN:
+    platformInstance->dispatchEvent(
+        event{eventType::mousedown, static_cast<short>(LOWORD(lParam)),
+              static_cast<short>(HIWORD(lParam)), 1});
+    handled = true;
+    break;
+  case WM_LBUTTONUP:
+    platformInstance->dispatchEvent(
+        event{eventType::mouseup, static_cast<short>(LOWORD(lParam)),
+              static_cast<short>(HIWORD(lParam)), 1});
+    handled = true;
+    break;
+  case WM_MBUTTONDOWN:
+    platformInstance->dispatchEvent(
+        event{eventType::mousedown, static_cast<short>(LOWORD(lParam)),
+              static_cast<short>(HIWORD(lParam)), 2});
+    handled = true;
+    break;
+  case WM_MBUTTONUP:
+    platformInstance->dispatchEvent(
+        event{eventType::mouseup, static_cast<short>(LOWORD(lParam)),
+              static_cast<short>(HIWORD(lParam)), 2});
+    handled = true;
+    break;
+  case WM_RBUTTONDOWN:
+    platformInstance->dispatchEvent(
+        event{eventType::mousedown, static_cast<short>(LOWORD(lParam)),
+              static_cast<short>(HIWORD(lParam)), 3});
+    handled = true;
+    break;
+  case WM_RBUTTONUP:
+    platformInstance->dispatchEvent(
+        event{eventType::mouseup, static_cast<short>(LOWORD(lParam)),
+              static_cast<short>(HIWORD(lParam)), 3});
+    handled = true;
+    break;
+  case WM_MOUSEMOVE:
+    platformInstance->dispatchEvent(event{eventType::mousemove,
+                                          static_cast<short>(LOWORD(lParam)),
+                                          static_cast<short>(HIWORD(lParam))});
+    result = 0;
+    handled = true;
+    break;
+  case WM_MOUSEWHEEL: {
+    platformInstance->dispatchEvent(event{
+        eventType::wheel, static_cast<short>(LOWORD(lParam)),
+        static_cast<short>(HIWORD(lParam)), GET_WHEEL_DELTA_WPARAM(wParam)});
+    handled = true;
+  } break;
+  case WM_DISPLAYCHANGE:
+    InvalidateRect(hwnd, NULL, FALSE);
+    result = 0;
+    handled = true;
+    break;
+  case WM_PAINT: {
+    PAINTSTRUCT ps;
+    HDC hdc = BeginPaint(hwnd, &ps);
+    platformInstance->dispatchEvent(event{eventType::paint});
+    EndPaint(hwnd, &ps);
+    ValidateRect(hwnd, NULL);
+    result = 0;
+    handled = true;
+  } break;
+  case WM_DESTROY:
+    PostQuitMessage(0);
+    result = 1;
+    handled = true;
+    break;
+  }
+  if (!handled)
+    result = DefWindowProc(hwnd, message, wParam, lParam);
+  return result;
+}
+#endif
+
+/**
+\internal
+\brief the routine handles the message processing for the specific
+operating system. The function is called from processEvents.
+
+*/
+void uxdevice::platform::messageLoop(void) {
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
+  xcb_generic_event_t *xcbEvent;
+  bool bRequestResize = false;
+  short int newWidth;
+  short int newHeight;
+
+  // the latest size is applied once the events received so far are handled.
+  auto applyResize = [&]() {
+    if (!bRequestResize)
+      return;
+    dispatchEvent(event{eventType::resize, newWidth, newHeight});
+    requestFrame();
+    bRequestResize = false;
+  };
+
+  while (!xcb_connection_has_error(m_connection)) {
+    // buffer completion and present events have codes assigned by the
+    // server.
+    xcbEvent = nextEvent();
+    if (xcbEvent && (completion(xcbEvent) || frameNotify(xcbEvent))) {
+      free(xcbEvent);
+      xcbEvent = nullptr;
+    }
+
+    if (xcbEvent) {
+      switch (xcbEvent->response_type & ~0x80) {
+      case XCB_MOTION_NOTIFY: {
+        xcb_motion_notify_event_t *motion =
+            (xcb_motion_notify_event_t *)xcbEvent;
+        dispatchEvent(event{
+            eventType::mousemove,
+            motion->event_x,
+            motion->event_y,
+        });
+      } break;
+      case XCB_BUTTON_PRESS: {
+        xcb_button_press_event_t *bp = (xcb_button_press_event_t *)xcbEvent;
+        if (bp->detail == XCB_BUTTON_INDEX_4 ||
+            bp->detail == XCB_BUTTON_INDEX_5) {
+          // the steps of consecutive wheel events are summed.
+          short distance = bp->detail == XCB_BUTTON_INDEX_4 ? 1 : -1;
+          while (!m_pendingEvents.empty() &&
+                 (m_pendingEvents.front()->response_type & ~0x80) ==
+                     XCB_BUTTON_PRESS) {
+            xcb_button_press_event_t *next =
+                (xcb_button_press_event_t *)m_pendingEvents.front();
+            if (next->detail != XCB_BUTTON_INDEX_4 &&
+                next->detail != XCB_BUTTON_INDEX_5)
+              break;
+            distance += next->detail == XCB_BUTTON_INDEX_4 ? 1 : -1;
+            free(next);
+            m_pendingEvents.pop_front();
+          }
+          dispatchEvent(
+              event{eventType::wheel, bp->event_x, bp->event_y, distance});
+
+        } else {
+          dispatchEvent(event{eventType::mousedown, bp->event_x, bp->event_y,
+                              bp->detail});
+        }
+      } break;
+      case XCB_BUTTON_RELEASE: {
+        xcb_button_release_event_t *br = (xcb_button_release_event_t *)xcbEvent;
+        // ignore button 4 and 5 which are wheel events.
+        if (br->detail != XCB_BUTTON_INDEX_4 &&
+            br->detail != XCB_BUTTON_INDEX_5)
+          dispatchEvent(
+              event{eventType::mouseup, br->event_x, br->event_y, br->detail});
+      } break;
+      case XCB_KEY_PRESS: {
+        xcb_key_press_event_t *kp = (xcb_key_press_event_t *)xcbEvent;
+        xcb_keysym_t sym = xcb_key_press_lookup_keysym(m_syms, kp, 0);
+        if (sym < 0x99) {
+          XKeyEvent keyEvent;
+          keyEvent.display = m_xdisplay;
+          keyEvent.keycode = kp->detail;
+          keyEvent.state = kp->state;
+          std::array<char, 16> buf{};
+          if (XLookupString(&keyEvent, buf.data(), buf.size(), nullptr,
+                            nullptr))
+            dispatchEvent(event{eventType::keypress, (char)buf[0]});
+        } else {
+          dispatchEvent(event{eventType::keydown, sym});
+        }
+      } break;
+      case XCB_KEY_RELEASE: {
+        xcb_key_release_event_t *kr = (xcb_key_release_event_t *)xcbEvent;
+        xcb_keysym_t sym = xcb_key_press_lookup_keysym(m_syms, kr, 0);
+        dispatchEvent(event{eventType::keyup, sym});
+      } break;
+      case XCB_EXPOSE: {
+        xcb_expose_event_t *expose = (xcb_expose_event_t *)xcbEvent;
+        if (bRequestResize) {
+          dispatchEvent(event{eventType::resize, newWidth, newHeight});
+          bRequestResize = false;
+        }
+
+        // the damage and buffers are shared with the render thread.
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+
+        // a synthetic expose without an area requests a new frame.
+        if (!expose->width || !expose->height)
+          m_bSceneChanged = true;
+        else
+          m_damage.emplace_back(expose->x, expose->y,
+                                expose->x + expose->width,
+                                expose->y + expose->height);
+
+        // the exposed areas of an unchanged scene are presented from the
+        // retained frame.
+        if (expose->count == 0) {
+          if (sceneChanged() || !m_bPresented)
+            requestFrame();
+          else
+            present((m_backBuffer + m_buffers.size() - 1) % m_buffers.size(),
+                    m_damage);
+        }
+      } break;
+      case XCB_GRAPHICS_EXPOSURE: {
+        // areas a scroll could not copy on the screen are sent.
+        xcb_graphics_exposure_event_t *exposure =
+            (xcb_graphics_exposure_event_t *)xcbEvent;
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+        m_damage.emplace_back(exposure->x, exposure->y,
+                              exposure->x + exposure->width,
+                              exposure->y + exposure->height);
+        if (exposure->count == 0 && m_bPresented)
+          present((m_backBuffer + m_buffers.size() - 1) % m_buffers.size(),
+                  m_damage);
+      } break;
+      case XCB_CONFIGURE_NOTIFY: {
+        const xcb_configure_notify_event_t *cfgEvent =
+            (const xcb_configure_notify_event_t *)xcbEvent;
+        if (cfgEvent->window == m_window) {
+          newWidth = cfgEvent->width;
+          newHeight = cfgEvent->height;
+          if ((newWidth != _w || newHeight != _h) && (newWidth > 0) &&
+              (newHeight > 0)) {
+            bRequestResize = true;
+          }
+        }
+      }
+      }
+    }
+    free(xcbEvent);
+
+    // while a window is dragged, only the last configure is applied.
+    if (bRequestResize && !eventsPending())
+      applyResize();
+
+    // scrolls posted by the handlers or other threads are applied, display
+    // lists published by them request a frame.
+    applyScrolls();
+    if (!m_bFrameRequested && m_bPresented && sceneChanged() &&
+        m_pendingEvents.empty())
+      requestFrame();
+
+    // a frame is produced once the batch of received events is handled. No
+    // event is returned by nextEvent when a requested frame is due.
+    if (m_bFrameRequested && m_pendingEvents.empty() && !frameTimeout())
+      presentFrame();
+  }
+#elif defined(USE_DIRECT_SCREEN_OUTPUT) && defined(_WIN64)
+  MSG msg;
+  while (GetMessage(&msg, NULL, 0, 0)) {
+    TranslateMessage(&msg);
+    DispatchMessage(&msg);
+  }
+#endif
+}
+
+#if defined(USE_FREETYPE)
+/**
+\internal
+\brief The faceRequestor is a callback routine that provides
+creation of a face object. The parameter face_id is a pointer
+that is named as user information by the cache system.
+
+\param FTC_FaceID face_id the user generated index
+\param FT_Library library handle to the free type library
+\param FT_Pointer request_data unused
+\param FT_Face *aface the newly ycreated fash object.
+*/
+FT_Error uxdevice::platform::faceRequestor(FTC_FaceID face_id,
+                                           FT_Library library,
+                                           FT_Pointer request_data,
+                                           FT_Face *aface) {
+  FT_Error error;
+  faceCacheStruct *fID = static_cast<faceCacheStruct *>(face_id);
+  error = FT_New_Face(library, fID->filePath.data(), 0, aface);
+
+  // we want to use unicode
+  error = FT_Select_Charmap(*aface, FT_ENCODING_UNICODE);
+
+  return error;
+}
+#endif
+
+/**
+\internal
+\brief The function provides the building and location of a textFace name
+The function independently works on linux vs. windows. The linux is much
+more advanced in that it uses the fontconfig api. This api provides for
+family matching as a browser would incorporate. Whereas the windows portion
+uses the registry access and simply compares a string.
+
+The function comes from the following source:
+https://stackoverflow.com/questions/10542832/how-to-use-fontconfig-to-get-font-list-c-c
+https://stackoverflow.com/questions/3954223/platform-independent-way-to-get-font-directory
+
+\param sTextFace
+
+*/
+
+#if defined(USE_FREETYPE)
+
+std::string uxdevice::platform::getFontFilename(const std::string &sTextFace) {
+  std::string fontFileReturn;
+
+#if defined(__linux__)
+
+  FcConfig *config = FcInitLoadConfigAndFonts();
+
+  // configure the search pattern,
+  // assume "name" is a std::string with the desired font name in it
+  FcPattern *pat = FcNameParse((const FcChar8 *)(sTextFace.c_str()));
+  FcConfigSubstitute(config, pat, FcMatchPattern);
+  FcDefaultSubstitute(pat);
+
+  // find the font
+  FcResult ret;
+  FcPattern *font = FcFontMatch(config, pat, &ret);
+  if (font) {
+    FcChar8 *file = NULL;
+    if (FcPatternGetString(font, FC_FILE, 0, &file) == FcResultMatch) {
+      // save the file to another std::string
+      fontFileReturn = (char *)file;
+    }
+    FcPatternDestroy(font);
+  }
+
+  FcPatternDestroy(pat);
+
+#elif defined(_WIN64)
+
+  wstring subKey = L"Software\\Microsoft\\Windows NT\\CurrentVersion\\Fonts";
+
+  HKEY regKey = 0;
+  LONG ret;
+  wstring wsName;
+  DWORD dwNameSize;
+  vector<BYTE> vValue;
+  DWORD dwValueSize;
+  DWORD dwType = 0;
+  DWORD index = 0;
+  wstring wsSearch;
+
+  // convert input string to a multibyte wstring.
+  int wsSize =
+      MultiByteToWideChar(CP_ACP, MB_ERR_INVALID_CHARS, sTextFace.data(),
+                          sTextFace.size(), wsSearch.data(), 0);
+  wsSearch.resize(wsSize);
+  MultiByteToWideChar(CP_ACP, MB_ERR_INVALID_CHARS, sTextFace.data(),
+                      sTextFace.size(), wsSearch.data(), wsSize);
+
+  // open the registry key
+  ret = RegOpenKeyExW(HKEY_LOCAL_MACHINE, subKey.c_str(), 0, KEY_READ, &regKey);
+  if (ret != ERROR_SUCCESS) {
+    string errorCode;
+    errorCode = "Could not open windows registry (" + to_string(ret) + ")";
+    throw std::runtime_error(errorCode);
+  }
+
+  // get the number of entries
+  DWORD valueCount;
+  DWORD maxValueNameLen;
+  DWORD maxValueLen;
+
+  // get the numer of items and the maximum lengths.
+  ret = RegQueryInfoKey(regKey, nullptr, nullptr, nullptr, nullptr, nullptr,
+                        nullptr, &valueCount, &maxValueNameLen, &maxValueLen,
+                        nullptr, nullptr);
+  if (ret != ERROR_SUCCESS) {
+    string errorCode;
+    errorCode = "Could not open windows registry (" + to_string(ret) + ")";
+    throw std::runtime_error(errorCode);
+  }
+
+  // resize for space and clear
+  maxValueLen++;
+  maxValueNameLen++;
+  wsName.resize(maxValueNameLen);
+  vValue.resize(maxValueLen);
+  bool bFound = false;
+
+  // look for a match
+  for (DWORD index = 0; index < valueCount; index++) {
+
+    // get registry value
+    dwNameSize = maxValueNameLen;
+    dwValueSize = maxValueLen;
+    ret = RegEnumValueW(regKey, index, wsName.data(), &dwNameSize, NULL,
+                        &dwType, vValue.data(), &dwValueSize);
+    if (ret != ERROR_SUCCESS) {
+      string errorCode;
+      errorCode = "Could not open windows registry (" + to_string(ret) + ")";
+      throw std::runtime_error(errorCode);
+    }
+
+    // match name or file names
+    if (_wcsnicmp(wsName.c_str(), wsSearch.c_str(), wsSearch.size()) == 0) {
+      bFound = true;
+      break;
+    }
+  }
+
+  // close the registry key
+  RegCloseKey(regKey);
+
+  /**
+    Some font filenames within the registry have the path built in
+    while most windows fonts do not. This provides the full path.
+    For simplicity, check the second and third characters of the
+    file name to determine if it has a drive specifier.
+  */
+  LPWSTR lpwData = reinterpret_cast<LPWSTR>(vValue.data());
+  wstring wsfontFileReturn;
+
+  // if (!bFound)
+  // wcscpy_s(lpwData, L"arial.ttf");
+
+  if (_wcsnicmp(lpwData + 1, L":\\", 2) == 0) {
+    wsfontFileReturn = lpwData;
+
+  } else {
+    wsfontFileReturn.resize(MAX_PATH);
+    int lLen = GetSystemWindowsDirectoryW(wsfontFileReturn.data(), MAX_PATH);
+    wsfontFileReturn.resize(lLen);
+    wsfontFileReturn.append(L"\\Fonts\\");
+    wsfontFileReturn.append(lpwData);
+  }
+
+  // convert the widestring to an utf8 or default character representation
   fontFileReturn.resize(MAX_PATH);
   DWORD dw =
       WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS,
@@ -916,820 +2468,3496 @@ std::string uxdevice::platform::getFontFilename(const std::string &sTextFace) {
   fontFileReturn.resize(dw);
 #endif
 
-  return fontFileReturn;
+  return fontFileReturn;
+}
+#endif // defined
+
+/**
+\internal
+\brief The drawText function provides textual character rendering.
+
+\param std::string
+Optimized Blend
+https://www.codeguru.com/cpp/cpp/algorithms/general/article.php/c15989/Tip-An-Optimized-Formula-for-Alpha-Blending-Pixels.htm
+
+*/
+void uxdevice::platform::activateTextFace(void) {
+#if defined(USE_FREETYPE)
+  // store a cache record for loaded fonts.
+  m_faceID = getFaceID(std::string(m_textFace));
+
+  // having this as a local variable
+  m_scaler.face_id = m_faceID;
+  m_scaler.pixel = 0;
+
+  // the size is scaled by the lengths of the transformed axes. The glyphs of
+  // each size are held in the cache.
+  m_textScaleX = m_transform.scaleX();
+  m_textScaleY = m_transform.scaleY();
+  m_scaler.height = std::max(
+      std::lround((m_pointSize + m_renderScale) * m_textScaleY * 64), 64l);
+  m_scaler.width = std::max(
+      std::lround((m_pointSize + m_renderScale) * m_textScaleX * 64), 64l);
+
+  m_scaler.x_res = 96;
+  m_scaler.y_res = 96;
+
+  // get the face
+  m_error = FTC_Manager_LookupSize(m_cacheManager, &m_scaler, &m_sizeFace);
+
+  if (m_error)
+    throw std::runtime_error("Could not retrieve font face.");
+
+  m_error = FT_Activate_Size(m_sizeFace);
+  if (m_error)
+    throw std::runtime_error("Could FT_Activate_Size for font.");
+  m_faceHeight = m_sizeFace->face->size->metrics.height >> 6;
+
+#endif // defined
+
+}
+
+/**
+\internal
+\brief The drawText function provides textual character rendering.
+
+\param std::string
+Optimized Blend
+https://www.codeguru.com/cpp/cpp/algorithms/general/article.php/c15989/Tip-An-Optimized-Formula-for-Alpha-Blending-Pixels.htm
+
+*/
+#if defined(USE_FREETYPE)
+void uxdevice::platform::renderText(const std::size_t &beginIndex,
+                                    const std::size_t &endIndex) {
+  // text is drawn once a face of the list is selected, the face is sized
+  // for the transform of the item.
+  if (m_textFace.empty())
+    return;
+  if (m_transform.scaleX() != m_textScaleX ||
+      m_transform.scaleY() != m_textScaleY)
+    activateTextFace();
+
+  // set the text pen rendering position
+  m_xpos = m_targetArea.x1;
+  m_ypos = m_targetArea.y1;
+
+  m_bProcessedOnce = false;
+
+  // iterate characters in string
+  const rectangle &clip = m_surface.clipArea();
+  std::size_t end = std::min(endIndex, m_stringData.size());
+  for (std::size_t idx = beginIndex; idx < end; idx++) {
+
+    // exit when rectangle has been filled, or the lines left are below the
+    // clip.
+    if (m_ypos > m_targetArea.y2 || m_ypos >= clip.y2)
+      break;
+
+    // lines only break at newlines, so a line well above the clip, such as
+    // one above the strip exposed by a scroll, is passed over without
+    // looking up its glyphs.
+    if (m_ypos + 2 * m_faceHeight <= clip.y1) {
+      const void *newline =
+          memchr(m_stringData.data() + idx, '\n', end - idx);
+      if (!newline)
+        break;
+      idx = static_cast<const char *>(newline) - m_stringData.data();
+      renderChar('\n');
+      continue;
+    }
+
+    renderChar(m_stringData[idx]);
+  }
+}
+
+/**
+\internal
+\brief The function provides the rendering of a individual character
+\details
+The routine provides the individual rendering of a character.
+
+Special
+characters such as escape characters are filtered.
+
+
+\param const char c is the individual character
+
+*/
+int uxdevice::platform::renderChar(const char c) {
+  FT_Error error;
+  unsigned int color = 0x00; // computed color
+  int x, y;
+  const int CtabStap = 50;
+
+  // handle special characters
+  // new line
+  switch (c) {
+  case '\n':
+    // kerning does not carry across lines.
+    m_xpos = m_targetArea.x1;
+    m_ypos += m_faceHeight;
+    m_bProcessedOnce = false;
+    return 0;
+    break;
+  case '\t':
+    m_xpos += CtabStap;
+    return CtabStap;
+    break;
+  }
+
+  // get the index of the glyph
+  m_glyph_index = FTC_CMapCache_Lookup(m_cmapCache, m_faceID, 0, c);
+  FT_Face face = m_sizeFace->face;
+
+  // the kerning of a font depends on the previous character
+  // some proportional fonts provide tighter spacing which improves
+  // rendering characteristics
+  if (m_bProcessedOnce && FT_HAS_KERNING(face)) {
+    FT_Vector akerning;
+    error = FT_Get_Kerning(face, m_previous_index, m_glyph_index,
+                           FT_KERNING_DEFAULT, &akerning);
+    if (!error) {
+      m_xpos += akerning.x >> 6;
+    }
+  }
+
+  // get the height of the font
+  int baseline = face->size->metrics.ascender >> 6;
+
+  /**
+  \brief use greyscale or color lcd filtering
+\details
+      There are two distinct types of bimap structures that are in use, grey
+      scale or lcd filtered. The buffer format is unique for each, the grey
+  lite one being a value indicating grey luminence while the lcd filter is a
+  rgb one. These values provide the same functionality for the looping and
+      drawing routine. You will notice that within each block of code, after
+      getting the image, these values are set.
+  */
+  int storageSize, pitch, top, left, height, width, xadvance;
+  unsigned char *buffer;
+
+#ifdef USE_FREETYPE_GREYSCALE_ANTIALIAS
+  // get the image
+  FTC_SBit bitmap;
+  error = FTC_SBitCache_LookupScaler(m_bitCache, &m_scaler, FT_LOAD_RENDER,
+                                     m_glyph_index, &bitmap, nullptr);
+
+  if (error)
+    return 0;
+
+  // set the rendering values used for grey
+  storageSize = 1;
+  pitch = bitmap->pitch;
+  top = bitmap->top;
+  left = bitmap->left;
+  height = bitmap->height;
+  width = bitmap->width;
+  buffer = bitmap->buffer;
+  xadvance = bitmap->xadvance;
+
+#elif defined (USE_FREETYPE_LCD_FILTER)
+  FT_Glyph aglyph;
+  FT_BitmapGlyph bitmap;
+
+  // get the image, however this is just the outline
+  error = FTC_ImageCache_LookupScaler(m_imageCache, &m_scaler, FT_LOAD_DEFAULT,
+                                      m_glyph_index, &aglyph, nullptr);
+  if (error)
+    return 0;
+
+  xadvance = (aglyph->advance.x + 0x8000) >> 16;
+
+  // glyphs outside of the clip, such as those of lines scrolled out of
+  // view or cut by a pushClip, are only advanced. The lcd filter spreads a
+  // glyph by a pixel to each side.
+  FT_BBox box;
+  FT_Glyph_Get_CBox(aglyph, FT_GLYPH_BBOX_PIXELS, &box);
+  const rectangle &clip = m_surface.clipArea();
+  if (m_ypos + baseline - box.yMax >= clip.y2 ||
+      m_ypos + baseline - box.yMin <= clip.y1 ||
+      m_xpos + box.xMin - 1 >= clip.x2 || m_xpos + box.xMax + 1 <= clip.x1) {
+    m_previous_index = m_glyph_index;
+    m_bProcessedOnce = true;
+    m_xpos += xadvance;
+    return xadvance;
+  }
+
+  // this converts the outline image to a rgb bitmap
+  error = FT_Glyph_To_Bitmap(&aglyph, FT_RENDER_MODE_LCD, 0, 0);
+  bitmap = reinterpret_cast<FT_BitmapGlyph>(aglyph);
+
+  // set the rendering values used for for grey
+  storageSize = 3;
+  pitch = bitmap->bitmap.pitch;
+  top = bitmap->top;
+  left = bitmap->left;
+  height = bitmap->bitmap.rows;
+  width = bitmap->bitmap.width;
+  buffer = bitmap->bitmap.buffer;
+
+#endif
+
+  x = m_xpos;
+  y = m_ypos + baseline - top;
+  color = (m_textColorR << 16) | (m_textColorG << 8) | m_textColorB;
+
+  // the glyph is blended row by row, the surface clips to the target area.
+  for (int j = 0; j < height; j++)
+    m_surface.blend(x + left, y + j, buffer + j * pitch, storageSize, color,
+                    width / storageSize);
+
+#ifdef USE_FREETYPE_LCD_FILTER
+  // delete the bitmap data
+  FT_Done_Glyph((FT_Glyph)bitmap);
+
+#endif
+  m_previous_index = m_glyph_index;
+  m_bProcessedOnce = true;
+  m_xpos += xadvance;
+
+  return xadvance;
+}
+#endif
+
+/**
+\internal
+\brief the function returns the byte position of each channel, blue,
+green, red and alpha, within a pixel of the given format.
+*/
+static const u_int8_t *channelPositions(const pixelFormat format) {
+  static const u_int8_t rgba[4] = {2, 1, 0, 3};
+  static const u_int8_t bgra[4] = {0, 1, 2, 3};
+  static const u_int8_t argb[4] = {3, 2, 1, 0};
+  switch (format) {
+  case pixelFormat::rgba:
+    return rgba;
+  case pixelFormat::argb:
+    return argb;
+  default:
+    return bgra;
+  }
+}
+
+/**
+\internal
+\brief multiplies two 8 bit values and divides by 255, rounded. This is
+exact for all inputs and is the same computation used by the vector code.
+*/
+static inline u_int8_t mul255(const unsigned int x, const unsigned int a) {
+  unsigned int t = x * a + 128;
+  return (t + (t >> 8)) >> 8;
+}
+
+/**
+\internal
+\brief converts a floating point quantum to 8 bits. Values outside of the
+range saturate and NaN becomes zero.
+*/
+static inline u_int8_t floatTo8(const float v, const float scale) {
+  float f = v * scale;
+  f = (255.0f < f ? 255.0f : f) + 0.5f;
+  return !(f > 0) ? 0 : f >= 255.0f ? 255 : static_cast<u_int8_t>(f);
+}
+
+/**
+\internal
+\brief converts a 16 bit quantum to 8 bits, rounded.
+*/
+static inline u_int8_t shortTo8(const unsigned int v) {
+  unsigned int t = std::min(v + 128, 65535u);
+  return (t - (t >> 8)) >> 8;
+}
+
+static void swizzleScalar(const u_int8_t *src, u_int8_t *dst,
+                          const u_int8_t *order, size_t count) {
+  for (; count; count--, src += 4, dst += 4) {
+    u_int8_t p[4] = {src[0], src[1], src[2], src[3]};
+    dst[0] = p[order[0]];
+    dst[1] = p[order[1]];
+    dst[2] = p[order[2]];
+    dst[3] = p[order[3]];
+  }
+}
+
+static void premultiplyScalar(const u_int8_t *src, u_int8_t *dst,
+                              size_t count) {
+  for (; count; count--, src += 4, dst += 4) {
+    unsigned int alpha = src[3];
+    dst[0] = mul255(src[0], alpha);
+    dst[1] = mul255(src[1], alpha);
+    dst[2] = mul255(src[2], alpha);
+    dst[3] = alpha;
+  }
+}
+
+static void fromFloatScalar(const float *src, const int channels,
+                            const float range, u_int8_t *dst, size_t count) {
+  const float scale = 255.0f / range;
+  for (; count; count--, src += channels, dst += 4) {
+    dst[0] = floatTo8(src[2], scale);
+    dst[1] = floatTo8(src[1], scale);
+    dst[2] = floatTo8(src[0], scale);
+    dst[3] = channels > 3 ? floatTo8(src[3], scale) : 255;
+  }
+}
+
+static void fromShortScalar(const uint16_t *src, const int channels,
+                            u_int8_t *dst, size_t count) {
+  for (; count; count--, src += channels, dst += 4) {
+    dst[0] = shortTo8(src[2]);
+    dst[1] = shortTo8(src[1]);
+    dst[2] = shortTo8(src[0]);
+    dst[3] = channels > 3 ? shortTo8(src[3]) : 255;
+  }
+}
+
+static void toFloatScalar(const u_int8_t *src, float *dst, const int channels,
+                          const float range, size_t count) {
+  const float scale = range / 255.0f;
+  for (; count; count--, src += 4, dst += channels) {
+    dst[0] = src[2] * scale;
+    dst[1] = src[1] * scale;
+    dst[2] = src[0] * scale;
+    if (channels > 3)
+      dst[3] = src[3] * scale;
+  }
+}
+
+static void toShortScalar(const u_int8_t *src, uint16_t *dst,
+                          const int channels, size_t count) {
+  for (; count; count--, src += 4, dst += channels) {
+    dst[0] = src[2] * 257;
+    dst[1] = src[1] * 257;
+    dst[2] = src[0] * 257;
+    if (channels > 3)
+      dst[3] = src[3] * 257;
+  }
+}
+
+static void blendScalar(u_int8_t *dst, const u_int8_t *coverage,
+                        const int coverageStep, const unsigned int color,
+                        size_t count) {
+  const unsigned int colorChannels[3] = {color & 0xFF, (color >> 8) & 0xFF,
+                                         (color >> 16) & 0xFF};
+  for (; count; count--, dst += 4, coverage += coverageStep) {
+    for (int c = 0; c < 3; c++) {
+      // lcd coverage is ordered red, green, blue.
+      unsigned int cover = coverage[coverageStep == 1 ? 0 : 2 - c];
+      if (cover)
+        dst[c] = (colorChannels[c] * cover + dst[c] * (255 - cover)) >> 8;
+    }
+  }
+}
+
+static void fillScalar(u_int8_t *dst, const unsigned int color, size_t count) {
+  for (; count; count--, dst += 4)
+    memcpy(dst, &color, 4);
+}
+
+#if defined(__SSE2__)
+static void premultiplySSE2(const u_int8_t *src, u_int8_t *dst,
+                            size_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi16(128);
+  const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+  for (; count >= 4; count -= 4, src += 16, dst += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    __m128i halves[2] = {_mm_unpacklo_epi8(v, zero),
+                         _mm_unpackhi_epi8(v, zero)};
+    for (auto &h : halves) {
+      __m128i alpha = _mm_shufflehi_epi16(
+          _mm_shufflelo_epi16(h, _MM_SHUFFLE(3, 3, 3, 3)),
+          _MM_SHUFFLE(3, 3, 3, 3));
+      __m128i t = _mm_add_epi16(_mm_mullo_epi16(h, alpha), round);
+      t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+      h = _mm_or_si128(_mm_and_si128(alphaLanes, h),
+                       _mm_andnot_si128(alphaLanes, t));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                     _mm_packus_epi16(halves[0], halves[1]));
+  }
+  premultiplyScalar(src, dst, count);
+}
+
+static void fromFloatSSE2(const float *src, const int channels,
+                          const float range, u_int8_t *dst, size_t count) {
+  if (channels != 4) {
+    fromFloatScalar(src, channels, range, dst, count);
+    return;
+  }
+
+  const __m128 scale = _mm_set1_ps(255.0f / range);
+  const __m128 limit = _mm_set1_ps(255.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+
+  for (; count >= 4; count -= 4, src += 16, dst += 16) {
+    __m128i p[4];
+    for (int i = 0; i < 4; i++) {
+      __m128 f = _mm_mul_ps(_mm_loadu_ps(src + i * 4), scale);
+      f = _mm_add_ps(_mm_min_ps(limit, f), half);
+      // rgba to bgra
+      p[i] = _mm_shuffle_epi32(_mm_cvttps_epi32(f), _MM_SHUFFLE(3, 0, 1, 2));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                     _mm_packus_epi16(_mm_packs_epi32(p[0], p[1]),
+                                      _mm_packs_epi32(p[2], p[3])));
+  }
+  fromFloatScalar(src, channels, range, dst, count);
+}
+
+static void fromShortSSE2(const uint16_t *src, const int channels,
+                          u_int8_t *dst, size_t count) {
+  if (channels != 4) {
+    fromShortScalar(src, channels, dst, count);
+    return;
+  }
+
+  const __m128i round = _mm_set1_epi16(128);
+  for (; count >= 4; count -= 4, src += 16, dst += 16) {
+    __m128i p[2];
+    for (int i = 0; i < 2; i++) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src) + i);
+      v = _mm_adds_epu16(v, round);
+      v = _mm_srli_epi16(_mm_sub_epi16(v, _mm_srli_epi16(v, 8)), 8);
+      // rgba to bgra
+      p[i] = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 0, 1, 2)),
+                                 _MM_SHUFFLE(3, 0, 1, 2));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                     _mm_packus_epi16(p[0], p[1]));
+  }
+  fromShortScalar(src, channels, dst, count);
+}
+
+static void toFloatSSE2(const u_int8_t *src, float *dst, const int channels,
+                        const float range, size_t count) {
+  if (channels != 4) {
+    toFloatScalar(src, dst, channels, range, count);
+    return;
+  }
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 scale = _mm_set1_ps(range / 255.0f);
+  for (; count >= 4; count -= 4, src += 16, dst += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    __m128i halves[2] = {_mm_unpacklo_epi8(v, zero),
+                         _mm_unpackhi_epi8(v, zero)};
+    for (int i = 0; i < 4; i++) {
+      __m128i h = halves[i / 2];
+      __m128i p = i % 2 ? _mm_unpackhi_epi16(h, zero)
+                        : _mm_unpacklo_epi16(h, zero);
+      // bgra to rgba
+      p = _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 0, 1, 2));
+      _mm_storeu_ps(dst + i * 4, _mm_mul_ps(_mm_cvtepi32_ps(p), scale));
+    }
+  }
+  toFloatScalar(src, dst, channels, range, count);
+}
+
+static void toShortSSE2(const u_int8_t *src, uint16_t *dst,
+                        const int channels, size_t count) {
+  if (channels != 4) {
+    toShortScalar(src, dst, channels, count);
+    return;
+  }
+
+  for (; count >= 4; count -= 4, src += 16, dst += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    // a byte unpacked with itself is the value multiplied by 257.
+    __m128i halves[2] = {_mm_unpacklo_epi8(v, v), _mm_unpackhi_epi8(v, v)};
+    for (int i = 0; i < 2; i++) {
+      __m128i p = _mm_shufflehi_epi16(
+          _mm_shufflelo_epi16(halves[i], _MM_SHUFFLE(3, 0, 1, 2)),
+          _MM_SHUFFLE(3, 0, 1, 2));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst) + i, p);
+    }
+  }
+  toShortScalar(src, dst, channels, count);
+}
+
+static void blendSSE2(u_int8_t *dst, const u_int8_t *coverage,
+                      const int coverageStep, const unsigned int color,
+                      size_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i full = _mm_set1_epi16(255);
+  const __m128i colorVector = _mm_unpacklo_epi8(
+      _mm_set1_epi32(static_cast<int>(color & 0xFFFFFF)), zero);
+
+  for (; count >= 4; count -= 4, dst += 16, coverage += coverageStep * 4) {
+    // coverage of the blue, green and red bytes of four pixels.
+    __m128i cover;
+    if (coverageStep == 1) {
+      int32_t packed;
+      memcpy(&packed, coverage, sizeof(packed));
+      cover = _mm_cvtsi32_si128(packed);
+      cover = _mm_unpacklo_epi8(cover, cover);
+      cover = _mm_and_si128(_mm_unpacklo_epi16(cover, cover),
+                            _mm_set1_epi32(0xFFFFFF));
+    } else {
+      // lcd coverage is ordered red, green, blue.
+      const u_int8_t *c = coverage;
+      cover = _mm_set_epi32(c[11] | c[10] << 8 | c[9] << 16,
+                            c[8] | c[7] << 8 | c[6] << 16,
+                            c[5] | c[4] << 8 | c[3] << 16,
+                            c[2] | c[1] << 8 | c[0] << 16);
+    }
+
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst));
+    __m128i halves[2];
+    for (int i = 0; i < 2; i++) {
+      __m128i c16 = i ? _mm_unpackhi_epi8(cover, zero)
+                      : _mm_unpacklo_epi8(cover, zero);
+      __m128i d16 = i ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+      halves[i] = _mm_srli_epi16(
+          _mm_add_epi16(_mm_mullo_epi16(colorVector, c16),
+                        _mm_mullo_epi16(d16, _mm_sub_epi16(full, c16))),
+          8);
+    }
+
+    // channels without coverage are kept.
+    __m128i keep = _mm_cmpeq_epi8(cover, zero);
+    __m128i blended = _mm_packus_epi16(halves[0], halves[1]);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                     _mm_or_si128(_mm_and_si128(keep, d),
+                                  _mm_andnot_si128(keep, blended)));
+  }
+  blendScalar(dst, coverage, coverageStep, color, count);
+}
+
+static void fillSSE2(u_int8_t *dst, const unsigned int color, size_t count) {
+  const __m128i v = _mm_set1_epi32(static_cast<int>(color));
+  for (; count >= 4; count -= 4, dst += 16)
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), v);
+  fillScalar(dst, color, count);
+}
+#endif // __SSE2__
+
+#if defined(PIXEL_CONVERT_DISPATCH)
+__attribute__((target("ssse3"))) static void
+swizzleSSSE3(const u_int8_t *src, u_int8_t *dst, const u_int8_t *order,
+             size_t count) {
+  alignas(16) u_int8_t table[16];
+  for (int i = 0; i < 16; i++)
+    table[i] = (i & ~3) + order[i & 3];
+  const __m128i mask = _mm_load_si128(reinterpret_cast<__m128i *>(table));
+
+  for (; count >= 4; count -= 4, src += 16, dst += 16)
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(dst),
+        _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)), mask));
+  swizzleScalar(src, dst, order, count);
+}
+
+__attribute__((target("avx2"))) static void
+swizzleAVX2(const u_int8_t *src, u_int8_t *dst, const u_int8_t *order,
+            size_t count) {
+  alignas(32) u_int8_t table[32];
+  for (int i = 0; i < 32; i++)
+    table[i] = (i & 12) + order[i & 3];
+  const __m256i mask = _mm256_load_si256(reinterpret_cast<__m256i *>(table));
+
+  for (; count >= 8; count -= 8, src += 32, dst += 32)
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(dst),
+        _mm256_shuffle_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)), mask));
+  swizzleScalar(src, dst, order, count);
+}
+
+__attribute__((target("avx2"))) static void
+premultiplyAVX2(const u_int8_t *src, u_int8_t *dst, size_t count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i round = _mm256_set1_epi16(128);
+  const __m256i alphaLanes = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0,
+                                              0, 0, -1, 0, 0, 0);
+
+  for (; count >= 8; count -= 8, src += 32, dst += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+    __m256i halves[2] = {_mm256_unpacklo_epi8(v, zero),
+                         _mm256_unpackhi_epi8(v, zero)};
+    for (auto &h : halves) {
+      __m256i alpha = _mm256_shufflehi_epi16(
+          _mm256_shufflelo_epi16(h, _MM_SHUFFLE(3, 3, 3, 3)),
+          _MM_SHUFFLE(3, 3, 3, 3));
+      __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(h, alpha), round);
+      t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+      h = _mm256_blendv_epi8(t, h, alphaLanes);
+    }
+    // the unpack and pack operate within each lane so the order is kept.
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst),
+                        _mm256_packus_epi16(halves[0], halves[1]));
+  }
+  premultiplySSE2(src, dst, count);
+}
+
+__attribute__((target("avx2"))) static void
+fillAVX2(u_int8_t *dst, const unsigned int color, size_t count) {
+  const __m256i v = _mm256_set1_epi32(static_cast<int>(color));
+  for (; count >= 8; count -= 8, dst += 32)
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), v);
+  fillSSE2(dst, color, count);
+}
+#endif // PIXEL_CONVERT_DISPATCH
+
+/**
+\internal
+\brief the table of conversion functions selected for the cpu.
+*/
+typedef struct {
+  const char *name;
+  void (*swizzle)(const u_int8_t *, u_int8_t *, const u_int8_t *, size_t);
+  void (*premultiply)(const u_int8_t *, u_int8_t *, size_t);
+  void (*fromFloat)(const float *, const int, const float, u_int8_t *,
+                    size_t);
+  void (*fromShort)(const uint16_t *, const int, u_int8_t *, size_t);
+  void (*toFloat)(const u_int8_t *, float *, const int, const float, size_t);
+  void (*toShort)(const u_int8_t *, uint16_t *, const int, size_t);
+  void (*blend)(u_int8_t *, const u_int8_t *, const int, const unsigned int,
+                size_t);
+  void (*fill)(u_int8_t *, const unsigned int, size_t);
+} pixelKernels;
+
+/**
+\internal
+\brief The function returns the conversion functions for the cpu. The
+selection is made once, on first use.
+*/
+static const pixelKernels &kernels(void) {
+  static const pixelKernels selected = []() {
+    pixelKernels k = {"portable",      swizzleScalar,   premultiplyScalar,
+                      fromFloatScalar, fromShortScalar, toFloatScalar,
+                      toShortScalar,   blendScalar,     fillScalar};
+#if defined(__SSE2__)
+    k = {"sse2",        swizzleScalar, premultiplySSE2, fromFloatSSE2,
+         fromShortSSE2, toFloatSSE2,   toShortSSE2,     blendSSE2,
+         fillSSE2};
+#endif
+#if defined(PIXEL_CONVERT_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) {
+      k.name = "ssse3";
+      k.swizzle = swizzleSSSE3;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      k.name = "avx2";
+      k.swizzle = swizzleAVX2;
+      k.premultiply = premultiplyAVX2;
+      k.fill = fillAVX2;
+    }
+#endif
+    return k;
+  }();
+  return selected;
+}
+
+/**
+\internal
+\brief reorders the bytes of each pixel from one format to another. The
+source and destination may be the same memory.
+*/
+void uxdevice::pixelConvert::swizzle(const u_int8_t *src,
+                                     const pixelFormat srcFormat,
+                                     u_int8_t *dst,
+                                     const pixelFormat dstFormat,
+                                     const std::size_t count) {
+  if (srcFormat == dstFormat) {
+    if (src != dst)
+      memmove(dst, src, count * 4);
+    return;
+  }
+
+  const u_int8_t *from = channelPositions(srcFormat);
+  const u_int8_t *to = channelPositions(dstFormat);
+  u_int8_t order[4];
+  for (int c = 0; c < 4; c++)
+    order[to[c]] = from[c];
+  kernels().swizzle(src, dst, order, count);
+}
+
+/**
+\internal
+\brief multiplies the color channels of rgba or bgra pixels by their alpha.
+*/
+void uxdevice::pixelConvert::premultiply(const u_int8_t *src, u_int8_t *dst,
+                                         const std::size_t count) {
+  kernels().premultiply(src, dst, count);
+}
+
+/**
+\internal
+\brief divides the color channels of rgba or bgra pixels by their alpha.
+This is rare, it occurs only when premultiplied pixels are handed to code
+expecting straight alpha, so there is no vector version.
+*/
+void uxdevice::pixelConvert::unpremultiply(const u_int8_t *src,
+                                           u_int8_t *dst,
+                                           const std::size_t count) {
+  for (size_t i = 0; i < count * 4; i += 4) {
+    unsigned int alpha = src[i + 3];
+    for (int c = 0; c < 3; c++)
+      dst[i + c] =
+          alpha ? std::min(255u, (src[i + c] * 255u + alpha / 2) / alpha) : 0;
+    dst[i + 3] = alpha;
+  }
+}
+
+/**
+\internal
+\brief converts floating point quanta to bgra.
+*/
+void uxdevice::pixelConvert::fromQuantum(const float *src, const int channels,
+                                         const float range, u_int8_t *dst,
+                                         const std::size_t count) {
+  kernels().fromFloat(src, channels, range, dst, count);
+}
+
+/**
+\internal
+\brief converts 16 bit quanta to bgra.
+*/
+void uxdevice::pixelConvert::fromQuantum(const uint16_t *src,
+                                         const int channels,
+                                         const float range, u_int8_t *dst,
+                                         const std::size_t count) {
+  kernels().fromShort(src, channels, dst, count);
+}
+
+/**
+\internal
+\brief converts 8 bit quanta to bgra.
+*/
+void uxdevice::pixelConvert::fromQuantum(const u_int8_t *src,
+                                         const int channels,
+                                         const float range, u_int8_t *dst,
+                                         const std::size_t count) {
+  for (size_t i = 0; i < count; i++, src += channels, dst += 4) {
+    dst[0] = src[2];
+    dst[1] = src[1];
+    dst[2] = src[0];
+    dst[3] = channels > 3 ? src[3] : 255;
+  }
+}
+
+/**
+\internal
+\brief converts bgra to floating point quanta.
+*/
+void uxdevice::pixelConvert::toQuantum(const u_int8_t *src, float *dst,
+                                       const int channels, const float range,
+                                       const std::size_t count) {
+  kernels().toFloat(src, dst, channels, range, count);
+}
+
+/**
+\internal
+\brief converts bgra to 16 bit quanta.
+*/
+void uxdevice::pixelConvert::toQuantum(const u_int8_t *src, uint16_t *dst,
+                                       const int channels, const float range,
+                                       const std::size_t count) {
+  kernels().toShort(src, dst, channels, count);
+}
+
+/**
+\internal
+\brief converts bgra to 8 bit quanta.
+*/
+void uxdevice::pixelConvert::toQuantum(const u_int8_t *src, u_int8_t *dst,
+                                       const int channels, const float range,
+                                       const std::size_t count) {
+  for (size_t i = 0; i < count; i++, src += 4, dst += channels) {
+    dst[0] = src[2];
+    dst[1] = src[1];
+    dst[2] = src[0];
+    if (channels > 3)
+      dst[3] = src[3];
+  }
+}
+
+/**
+\internal
+\brief blends the color, 0xRRGGBB, into bgra pixels by glyph coverage. A
+coverageStep of one is a grey scale glyph, each value covers the three color
+channels of a pixel. A coverageStep of three is an lcd filtered glyph with
+red, green and blue coverage. Channels without coverage are not changed.
+*/
+void uxdevice::pixelConvert::blend(u_int8_t *dst, const u_int8_t *coverage,
+                                   const int coverageStep,
+                                   const unsigned int color,
+                                   const std::size_t count) {
+  kernels().blend(dst, coverage, coverageStep, color, count);
+}
+
+/**
+\internal
+\brief sets count bgra pixels to color.
+*/
+void uxdevice::pixelConvert::fill(u_int8_t *dst, const unsigned int color,
+                                  const std::size_t count) {
+  kernels().fill(dst, color, count);
+}
+
+/**
+\internal
+\brief returns the name of the selected implementation, one of avx2,
+ssse3, sse2 or portable.
+*/
+const char *uxdevice::pixelConvert::implementation(void) {
+  return kernels().name;
+}
+
+/**
+\internal
+\brief allocates a packed buffer of the given size. The memory is owned by
+the storage member.
+*/
+uxdevice::imageBuffer::imageBuffer(const int _width, const int _height)
+    : width(_width), height(_height), stride(_width * 4) {
+  auto v = make_shared<vector<u_int8_t>>(static_cast<size_t>(stride) * height);
+  pixels = v->data();
+  storage = v;
+}
+
+/**
+\internal
+\brief refers to existing pixels, the clip rectangle is the whole surface.
+*/
+uxdevice::surface::surface(u_int8_t *_pixels, const int _width,
+                           const int _height, const int _stride)
+    : pixels(_pixels), width(_width), height(_height), stride(_stride),
+      m_bounds(0, 0, _width, _height), m_clip(0, 0, _width, _height) {}
+
+/**
+\internal
+\brief limits drawing to r for the clip rectangles set later. The clip
+becomes r within the surface.
+*/
+void uxdevice::surface::limit(const rectangle &r) {
+  m_bounds = rectangle(0, 0, width, height);
+  clip(r);
+  m_bounds = m_clip;
+}
+
+/**
+\internal
+\brief limits drawing to r within the bounds.
+*/
+void uxdevice::surface::clip(const rectangle &r) {
+  m_clip.x1 = std::clamp(r.x1, m_bounds.x1, m_bounds.x2);
+  m_clip.y1 = std::clamp(r.y1, m_bounds.y1, m_bounds.y2);
+  m_clip.x2 = std::clamp(r.x2, m_clip.x1, m_bounds.x2);
+  m_clip.y2 = std::clamp(r.y2, m_clip.y1, m_bounds.y2);
+}
+
+/**
+\internal
+\brief sets every pixel of the surface to color, ignoring the clip. Packed
+rows are filled as a single span.
+*/
+void uxdevice::surface::clear(const unsigned int color) {
+  if (stride == width * 4) {
+    pixelConvert::fill(pixels, color, static_cast<size_t>(width) * height);
+    return;
+  }
+  for (int y = 0; y < height; y++)
+    pixelConvert::fill(row(y), color, width);
+}
+
+/**
+\internal
+\brief sets the pixels of r within the clip to color.
+*/
+void uxdevice::surface::fill(const rectangle &r, const unsigned int color) {
+  int x1 = std::max(r.x1, m_clip.x1);
+  int x2 = std::min(r.x2, m_clip.x2);
+  int y1 = std::max(r.y1, m_clip.y1);
+  int y2 = std::min(r.y2, m_clip.y2);
+  for (int y = y1; y < y2 && x1 < x2; y++)
+    pixelConvert::fill(row(y) + x1 * 4, color, x2 - x1);
+}
+
+/**
+\internal
+\brief copies the w by h block of src at srcX, srcY to x, y. The part of
+the block outside of the clip is skipped.
+*/
+void uxdevice::surface::copy(const int x, const int y, const imageBuffer &src,
+                             const int srcX, const int srcY, const int w,
+                             const int h) {
+  int x1 = std::max(x, m_clip.x1);
+  int x2 = std::min(x + w, m_clip.x2);
+  int y1 = std::max(y, m_clip.y1);
+  int y2 = std::min(y + h, m_clip.y2);
+  for (int j = y1; j < y2 && x1 < x2; j++)
+    memcpy(row(j) + x1 * 4,
+           src.pixels + static_cast<ptrdiff_t>(srcY + j - y) * src.stride +
+               (srcX + x1 - x) * 4,
+           (x2 - x1) * 4);
+}
+
+/**
+\internal
+\brief blends color into the span of count pixels at x, y by the coverage
+of a glyph row. coverageStep is the bytes of coverage per pixel, see
+pixelConvert::blend. The part of the span outside of the clip is skipped.
+*/
+void uxdevice::surface::blend(const int x, const int y,
+                              const u_int8_t *coverage,
+                              const int coverageStep,
+                              const unsigned int color, const int count) {
+  if (y < m_clip.y1 || y >= m_clip.y2)
+    return;
+
+  int x1 = std::max(x, m_clip.x1);
+  int x2 = std::min(x + count, m_clip.x2);
+  if (x1 < x2)
+    pixelConvert::blend(row(y) + x1 * 4, coverage + (x1 - x) * coverageStep,
+                        coverageStep, color, x2 - x1);
+}
+
+/**
+\internal
+\brief The function reduces the image to half of its size using a two by
+two box filter. Odd columns and rows at the edge are dropped. When sse2 is
+available, four destination pixels are produced per iteration by averaging
+the two rows and then the even and odd columns.
+*/
+static void boxDownsample(const imageBuffer &src, imageBuffer &dst) {
+  for (int y = 0; y < dst.height; y++) {
+    const u_int8_t *r0 = src.pixels + (y * 2) * src.stride;
+    const u_int8_t *r1 = src.height > 1 ? r0 + src.stride : r0;
+    u_int8_t *d = dst.pixels + y * dst.stride;
+    int x = 0;
+
+#if defined(__SSE2__)
+    for (; x + 4 <= dst.width && x * 2 + 8 <= src.width; x += 4) {
+      const __m128i *a = reinterpret_cast<const __m128i *>(r0 + x * 8);
+      const __m128i *b = reinterpret_cast<const __m128i *>(r1 + x * 8);
+      __m128 v0 = _mm_castsi128_ps(
+          _mm_avg_epu8(_mm_loadu_si128(a), _mm_loadu_si128(b)));
+      __m128 v1 = _mm_castsi128_ps(
+          _mm_avg_epu8(_mm_loadu_si128(a + 1), _mm_loadu_si128(b + 1)));
+      __m128i even =
+          _mm_castps_si128(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)));
+      __m128i odd =
+          _mm_castps_si128(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(d + x * 4),
+                       _mm_avg_epu8(even, odd));
+    }
+#endif
+
+    for (; x < dst.width; x++) {
+      int x0 = x * 2 * 4;
+      int x1 = src.width > 1 ? x0 + 4 : x0;
+      for (int c = 0; c < 4; c++)
+        d[x * 4 + c] =
+            (r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2;
+    }
+  }
+}
+
+/**
+\internal
+\brief The function resamples the source to a virtual image of
+destWidth x destHeight using a bilinear filter. Only the region
+[x1,x2) x [y1,y2) of the virtual image is produced, written to dest which
+points at the pixel for x1,y1. Coordinates are tracked in 16.16 fixed point,
+held in 64 bits so that sources wider than 32767 pixels do not overflow, and
+the weights use seven bits so the products fit within 16 bit lanes.
+*/
+static void resampleBilinear(const imageBuffer &src, const int destWidth,
+                             const int destHeight, const int x1, const int y1,
+                             const int x2, const int y2, u_int8_t *dest,
+                             const int destStride) {
+  const int64_t stepX = (static_cast<int64_t>(src.width) << 16) / destWidth;
+  const int64_t stepY = (static_cast<int64_t>(src.height) << 16) / destHeight;
+
+  // the column offsets and weights are the same for every row.
+  vector<int> col0(x2 - x1);
+  vector<int> col1(x2 - x1);
+  vector<short> weightX(x2 - x1);
+  for (int x = x1; x < x2; x++) {
+    int64_t pos = std::max<int64_t>(x * stepX + stepX / 2 - 0x8000, 0);
+    int sx = std::min<int64_t>(pos >> 16, src.width - 1);
+    col0[x - x1] = sx * 4;
+    col1[x - x1] = std::min(sx + 1, src.width - 1) * 4;
+    weightX[x - x1] = (pos >> 9) & 0x7f;
+  }
+
+  for (int y = y1; y < y2; y++) {
+    int64_t pos = std::max<int64_t>(y * stepY + stepY / 2 - 0x8000, 0);
+    int sy = std::min<int64_t>(pos >> 16, src.height - 1);
+    short weightY = (pos >> 9) & 0x7f;
+    const u_int8_t *r0 = src.pixels + static_cast<size_t>(sy) * src.stride;
+    const u_int8_t *r1 =
+        src.pixels +
+        static_cast<size_t>(std::min(sy + 1, src.height - 1)) * src.stride;
+    u_int8_t *d = dest + (y - y1) * destStride;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wy = _mm_set1_epi16(weightY);
+    for (int i = 0; i < x2 - x1; i++) {
+      unsigned int p00, p01, p10, p11;
+      memcpy(&p00, r0 + col0[i], 4);
+      memcpy(&p01, r0 + col1[i], 4);
+      memcpy(&p10, r1 + col0[i], 4);
+      memcpy(&p11, r1 + col1[i], 4);
+
+      // both columns are processed at once within the 16 bit lanes
+      __m128i top = _mm_unpacklo_epi8(
+          _mm_unpacklo_epi32(_mm_cvtsi32_si128(p00), _mm_cvtsi32_si128(p01)),
+          zero);
+      __m128i bottom = _mm_unpacklo_epi8(
+          _mm_unpacklo_epi32(_mm_cvtsi32_si128(p10), _mm_cvtsi32_si128(p11)),
+          zero);
+      __m128i v = _mm_add_epi16(
+          top,
+          _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(bottom, top), wy), 7));
+      __m128i right = _mm_unpackhi_epi64(v, v);
+      __m128i h = _mm_add_epi16(
+          v, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(right, v),
+                                            _mm_set1_epi16(weightX[i])),
+                            7));
+      unsigned int result = _mm_cvtsi128_si32(_mm_packus_epi16(h, h));
+      memcpy(d + i * 4, &result, 4);
+    }
+#else
+    for (int i = 0; i < x2 - x1; i++) {
+      for (int c = 0; c < 4; c++) {
+        int top = r0[col0[i] + c] +
+                  (((r1[col0[i] + c] - r0[col0[i] + c]) * weightY) >> 7);
+        int right = r0[col1[i] + c] +
+                    (((r1[col1[i] + c] - r0[col1[i] + c]) * weightY) >> 7);
+        d[i * 4 + c] = top + (((right - top) * weightX[i]) >> 7);
+      }
+    }
+#endif
+  }
+}
+
+/**
+\internal
+\brief The function samples count pixels of the source along a line using a
+bilinear filter, for drawing with a transform that rotates or shears. u, v
+is the position of the first pixel within the source, in pixel centers, and
+du, dv the step between pixels. The position is tracked in 16.16 fixed
+point. The caller limits the line to the pixels that map within the source,
+the columns and rows sampled are clamped at its edges.
+*/
+static void sampleAffine(const imageBuffer &src, const double u,
+                         const double v, const double du, const double dv,
+                         const int count, u_int8_t *dest) {
+  int64_t fu = std::llround(u * 65536.0);
+  int64_t fv = std::llround(v * 65536.0);
+  const int64_t fdu = std::llround(du * 65536.0);
+  const int64_t fdv = std::llround(dv * 65536.0);
+  const int64_t maxX = src.width - 1;
+  const int64_t maxY = src.height - 1;
+
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+#endif
+
+  for (int i = 0; i < count; i++, fu += fdu, fv += fdv) {
+    const int64_t sx = fu >> 16;
+    const int64_t sy = fv >> 16;
+    const int x0 = std::clamp<int64_t>(sx, 0, maxX) * 4;
+    const int x1 = std::clamp<int64_t>(sx + 1, 0, maxX) * 4;
+    const u_int8_t *r0 =
+        src.pixels + std::clamp<int64_t>(sy, 0, maxY) * src.stride;
+    const u_int8_t *r1 =
+        src.pixels + std::clamp<int64_t>(sy + 1, 0, maxY) * src.stride;
+    const short weightX = (fu >> 9) & 0x7f;
+    const short weightY = (fv >> 9) & 0x7f;
+
+#if defined(__SSE2__)
+    unsigned int p00, p01, p10, p11;
+    memcpy(&p00, r0 + x0, 4);
+    memcpy(&p01, r0 + x1, 4);
+    memcpy(&p10, r1 + x0, 4);
+    memcpy(&p11, r1 + x1, 4);
+
+    // both columns are processed at once within the 16 bit lanes
+    __m128i top = _mm_unpacklo_epi8(
+        _mm_unpacklo_epi32(_mm_cvtsi32_si128(p00), _mm_cvtsi32_si128(p01)),
+        zero);
+    __m128i bottom = _mm_unpacklo_epi8(
+        _mm_unpacklo_epi32(_mm_cvtsi32_si128(p10), _mm_cvtsi32_si128(p11)),
+        zero);
+    __m128i v = _mm_add_epi16(
+        top, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(bottom, top),
+                                            _mm_set1_epi16(weightY)),
+                            7));
+    __m128i right = _mm_unpackhi_epi64(v, v);
+    __m128i h = _mm_add_epi16(
+        v, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(right, v),
+                                          _mm_set1_epi16(weightX)),
+                          7));
+    unsigned int result = _mm_cvtsi128_si32(_mm_packus_epi16(h, h));
+    memcpy(dest + i * 4, &result, 4);
+#else
+    for (int c = 0; c < 4; c++) {
+      int top = r0[x0 + c] + (((r1[x0 + c] - r0[x0 + c]) * weightY) >> 7);
+      int right = r0[x1 + c] + (((r1[x1 + c] - r0[x1 + c]) * weightY) >> 7);
+      dest[i * 4 + c] = top + (((right - top) * weightX) >> 7);
+    }
+#endif
+  }
+}
+
+#if defined(USE_IMAGE_MAGICK)
+/**
+\internal
+\brief converts a region of a Magick image, at x and y and of the size of
+dst, to premultiplied bgra pixels.
+*/
+static void exportRegion(Magick::Image &image, const int x, const int y,
+                         imageBuffer &dst) {
+  Magick::Pixels view(image);
+  const Magick::Quantum *q = view.getConst(x, y, dst.width, dst.height);
+  const int channels = image.channels();
+  for (int row = 0; row < dst.height; row++) {
+    u_int8_t *p = dst.pixels + row * dst.stride;
+    pixelConvert::fromQuantum(
+        q + static_cast<size_t>(row) * dst.width * channels, channels,
+        QuantumRange, p, dst.width);
+    pixelConvert::premultiply(p, p, dst.width);
+  }
+}
+
+/**
+\internal
+\brief converts a Magick image to a packed bgra buffer which is the format
+used by the scaling kernels and the raw pixel file.
+*/
+static imageBuffer exportPixels(Magick::Image &image) {
+  imageBuffer pixels(image.columns(), image.rows());
+  exportRegion(image, 0, 0, pixels);
+  return pixels;
+}
+#endif // USE_IMAGE_MAGICK
+
+/**
+\internal
+\brief sets the source pixels of the cache, the scaled variants are
+discarded.
+*/
+void uxdevice::imageCache::source(const imageBuffer &_source,
+                                  const bool _bOwned) {
+  invalidate();
+  m_source = _source;
+  m_bOwned = _bOwned;
+  m_bEvicted = false;
+  m_seededLevels = 0;
+}
+
+/**
+\internal
+\brief returns the source pixels, restoring them when they were evicted.
+*/
+const imageBuffer &uxdevice::imageCache::source(void) {
+  restore();
+  return m_source;
+}
+
+/**
+\internal
+\brief discards the scaled variants. This should be called when the source
+pixels are changed by the client.
+*/
+void uxdevice::imageCache::invalidate(void) {
+  m_mips.clear();
+  m_entries.clear();
+  m_lastWidth = 0;
+  m_lastHeight = 0;
+}
+
+/**
+\internal
+\brief seeds the mip chain with levels that already exist, such as those
+stored within a raw pixel file. The first level is the source.
+*/
+void uxdevice::imageCache::levels(const std::vector<imageBuffer> &_levels) {
+  invalidate();
+  m_source = _levels.front();
+  m_bOwned = false;
+  m_bEvicted = false;
+  m_mips = _levels;
+  m_seededLevels = _levels.size();
+}
+
+/**
+\internal
+\brief returns the smallest level of the mip chain which is not smaller
+than the requested size. Levels are built as they are needed. Level zero is
+the source.
+*/
+const imageBuffer &uxdevice::imageCache::mip(const int w, const int h) {
+  if (m_mips.empty())
+    m_mips.push_back(m_source);
+
+  size_t level = 0;
+  while (true) {
+    const imageBuffer &current = m_mips[level];
+    if (current.width / 2 < w || current.height / 2 < h ||
+        current.width < 2 || current.height < 2)
+      break;
+
+    if (level + 1 == m_mips.size()) {
+      imageBuffer next(current.width / 2, current.height / 2);
+      boxDownsample(current, next);
+      m_mips.push_back(next);
+    }
+    level++;
+  }
+  return m_mips[level];
+}
+
+/**
+\internal
+\brief returns the pixels to use for drawing the image at the given size.
+When the same size is requested twice in a row, an exact entry is built and
+returned, drawing is then a copy. Otherwise the nearest mip level is
+returned and the caller resamples from it.
+*/
+const imageBuffer &uxdevice::imageCache::lookup(const int w, const int h) {
+#if defined(USE_STB_IMAGE)
+  if (m_vector)
+    return lookupVector(w, h);
+#endif
+
+  restore();
+
+  if (w == m_source.width && h == m_source.height)
+    return m_source;
+
+  for (auto it = m_entries.begin(); it != m_entries.end(); it++) {
+    if (it->width == w && it->height == h) {
+      m_entries.splice(m_entries.begin(), m_entries, it);
+      return m_entries.front();
+    }
+  }
+
+  bool bRepeated = w == m_lastWidth && h == m_lastHeight;
+  m_lastWidth = w;
+  m_lastHeight = h;
+
+  const imageBuffer &nearest = mip(w, h);
+  if (!bRepeated)
+    return nearest;
+
+  imageBuffer entry(w, h);
+  resampleBilinear(nearest, w, h, 0, 0, w, h, entry.pixels, entry.stride);
+  m_entries.push_front(entry);
+  if (m_entries.size() > maxEntries)
+    m_entries.pop_back();
+
+  return m_entries.front();
+}
+
+/**
+\internal
+\brief returns the intrinsic width of the image. For an svg, this is the
+width of the document.
+*/
+int uxdevice::imageCache::width(void) {
+#if defined(USE_STB_IMAGE)
+  if (m_vector)
+    return static_cast<int>(m_vector->width);
+#endif
+  restore();
+  return m_source.width;
+}
+
+/**
+\internal
+\brief returns the intrinsic height of the image.
+*/
+int uxdevice::imageCache::height(void) {
+#if defined(USE_STB_IMAGE)
+  if (m_vector)
+    return static_cast<int>(m_vector->height);
+#endif
+  restore();
+  return m_source.height;
+}
+
+/**
+\internal
+\brief returns true when the source is an svg document.
+*/
+bool uxdevice::imageCache::isVector(void) {
+#if defined(USE_STB_IMAGE)
+  return m_vector != nullptr;
+#else
+  return false;
+#endif
+}
+
+/**
+\internal
+\brief waits for background rasterization to finish.
+*/
+void uxdevice::imageCache::wait(void) {
+#if defined(USE_STB_IMAGE)
+  for (auto &pending : m_pending)
+    pending.task.wait();
+#endif
+}
+
+#if defined(USE_STB_IMAGE)
+/**
+\internal
+\brief rasterizes the svg document at the given size. The document is
+scaled uniformly to cover the size, when the aspect differs the result is
+resampled to the exact size. nanosvg produces straight RGBA, the pixels are
+swizzled to BGRA and premultiplied.
+*/
+static imageBuffer rasterizeVector(const std::shared_ptr<NSVGimage> &image,
+                                   const int w, const int h) {
+  imageBuffer buffer(w, h);
+  float scale = std::max(w / std::max(image->width, 1.0f),
+                         h / std::max(image->height, 1.0f));
+  int rw = std::max(static_cast<int>(std::ceil(image->width * scale)), w);
+  int rh = std::max(static_cast<int>(std::ceil(image->height * scale)), h);
+
+  NSVGrasterizer *rast = nsvgCreateRasterizer();
+  if (rw == w && rh == h) {
+    nsvgRasterize(rast, image.get(), 0, 0, scale, buffer.pixels, w, h,
+                  buffer.stride);
+  } else {
+    imageBuffer covered(rw, rh);
+    nsvgRasterize(rast, image.get(), 0, 0, scale, covered.pixels, rw, rh,
+                  covered.stride);
+    resampleBilinear(covered, w, h, 0, 0, w, h, buffer.pixels, buffer.stride);
+  }
+  nsvgDeleteRasterizer(rast);
+
+  for (int y = 0; y < h; y++) {
+    u_int8_t *row = buffer.pixels + y * buffer.stride;
+    pixelConvert::swizzle(row, pixelFormat::rgba, row, pixelFormat::bgra, w);
+    pixelConvert::premultiply(row, row, w);
+  }
+
+  return buffer;
+}
+
+/**
+\internal
+\brief sets an svg document as the source. Nothing is rasterized until
+the image is drawn.
+*/
+void uxdevice::imageCache::vectorSource(
+    const std::shared_ptr<NSVGimage> &_image) {
+  wait();
+  m_pending.clear();
+  source(imageBuffer());
+  m_vector = _image;
+}
+
+/**
+\internal
+\brief rasterizes the svg at exactly the given size, the raster is not
+cached.
+*/
+uxdevice::imageBuffer uxdevice::imageCache::rasterize(const int w,
+                                                      const int h) {
+  return rasterizeVector(m_vector, w, h);
+}
+
+/**
+\internal
+\brief returns the raster of the svg for the given size. Finished
+background rasterizations are collected first. The first raster is made
+synchronously. After that, a size which is not cached is rasterized in the
+background and the closest raster is returned for the caller to resample.
+Only one background rasterization runs at a time, the most recent size is
+requested again once it completes.
+*/
+const imageBuffer &uxdevice::imageCache::lookupVector(const int w,
+                                                      const int h) {
+  for (auto it = m_pending.begin(); it != m_pending.end();) {
+    if (it->result.wait_for(std::chrono::seconds(0)) ==
+        std::future_status::ready) {
+      m_entries.push_front(it->result.get());
+      it = m_pending.erase(it);
+    } else {
+      it++;
+    }
+  }
+  while (m_entries.size() > maxEntries)
+    m_entries.pop_back();
+
+  for (auto it = m_entries.begin(); it != m_entries.end(); it++) {
+    if (it->width == w && it->height == h) {
+      m_entries.splice(m_entries.begin(), m_entries, it);
+      return m_entries.front();
+    }
+  }
+
+  if (m_entries.empty()) {
+    m_entries.push_front(rasterizeVector(m_vector, w, h));
+    return m_entries.front();
+  }
+
+  if (m_pending.empty()) {
+    auto raster = make_shared<promise<imageBuffer>>();
+    auto image = m_vector;
+    auto ready = m_ready;
+    m_pending.push_back({w, h, raster->get_future(),
+                         std::async(std::launch::async, [=]() {
+                           raster->set_value(rasterizeVector(image, w, h));
+                           if (ready)
+                             ready();
+                         })});
+  }
+
+  // the smallest raster covering the size, otherwise the largest.
+  auto closest = m_entries.begin();
+  for (auto it = m_entries.begin(); it != m_entries.end(); it++) {
+    bool bCovers = it->width >= w && it->height >= h;
+    bool bClosestCovers = closest->width >= w && closest->height >= h;
+    if (bCovers ? !bClosestCovers || it->width < closest->width
+                : !bClosestCovers && it->width > closest->width)
+      closest = it;
+  }
+  return *closest;
+}
+#endif // USE_STB_IMAGE
+
+/**
+\internal
+\brief constructs the tiled image. No tiles are decoded until they are
+requested.
+*/
+uxdevice::tiledImage::tiledImage(const int _width, const int _height,
+                                 const tileDecoder &_decoder,
+                                 const std::size_t _capacity)
+    : width(_width), height(_height), m_decoder(_decoder),
+      m_capacity(_capacity) {}
+
+/**
+\internal
+\brief returns the tile at the given tile column and row, decoding it when
+it is not resident. Tiles at the right and bottom edges are smaller than
+tileSize. When the resident bytes exceed the capacity, the least recently
+used tiles are released. The returned reference remains valid until the next
+call.
+*/
+const imageBuffer &uxdevice::tiledImage::tile(const int tx, const int ty) {
+  int64_t key = (static_cast<int64_t>(ty) << 32) | static_cast<uint32_t>(tx);
+
+  auto it = m_index.find(key);
+  if (it != m_index.end()) {
+    m_tiles.splice(m_tiles.begin(), m_tiles, it->second);
+    return m_tiles.front().second;
+  }
+
+  imageBuffer buffer(std::min(tileSize, width - tx * tileSize),
+                     std::min(tileSize, height - ty * tileSize));
+  m_decoder(tx * tileSize, ty * tileSize, buffer);
+
+  m_tiles.push_front({key, buffer});
+  m_index[key] = m_tiles.begin();
+  m_residentBytes += static_cast<size_t>(buffer.stride) * buffer.height;
+
+  // release old tiles, the one just decoded is always kept.
+  while (m_residentBytes > m_capacity && m_tiles.size() > 1) {
+    const imageBuffer &old = m_tiles.back().second;
+    m_residentBytes -= static_cast<size_t>(old.stride) * old.height;
+    m_index.erase(m_tiles.back().first);
+    m_tiles.pop_back();
+  }
+
+  return m_tiles.front().second;
+}
+
+/**
+\internal
+\brief computes where the image is drawn within area, following the fit
+requested by the drawImage. The natural size of the image, and the src
+rectangle, are scaled by scaleX and scaleY when the image is drawn with a
+scaling transform. Tiled images are not scaled.
+*/
+uxdevice::platform::imagePlacement
+uxdevice::platform::placeImage(const drawImage &di, const rectangle &area,
+                               imageCache &pixels,
+                               const std::shared_ptr<tiledImage> &tiles,
+                               const double scaleX, const double scaleY) {
+  int targetWidth = area.x2 - area.x1;
+  int targetHeight = area.y2 - area.y1;
+  imageFit fit = tiles || !di.fit ? imageFit::crop : *di.fit;
+  const double sx = tiles ? 1.0 : scaleX;
+  const double sy = tiles ? 1.0 : scaleY;
+  int srcX = di.src && fit == imageFit::crop
+                 ? std::lround(std::max(di.src->x1, 0) * sx)
+                 : 0;
+  int srcY = di.src && fit == imageFit::crop
+                 ? std::lround(std::max(di.src->y1, 0) * sy)
+                 : 0;
+
+  int imageWidth = tiles ? tiles->width : pixels.width();
+  int imageHeight = tiles ? tiles->height : pixels.height();
+  if (pixels.isVector()) {
+    imageWidth = std::lround(imageWidth * m_deviceScale);
+    imageHeight = std::lround(imageHeight * m_deviceScale);
+  }
+  if (sx != 1.0 || sy != 1.0) {
+    imageWidth = std::max(std::lround(imageWidth * sx), 1l);
+    imageHeight = std::max(std::lround(imageHeight * sy), 1l);
+  }
+
+  // the placement of the image within the target area
+  int destX = area.x1;
+  int destY = area.y1;
+  int destWidth = imageWidth;
+  int destHeight = imageHeight;
+
+  if (fit == imageFit::stretch) {
+    destWidth = targetWidth;
+    destHeight = targetHeight;
+
+  } else if (fit == imageFit::fit) {
+    if (static_cast<long>(imageWidth) * targetHeight <
+        static_cast<long>(imageHeight) * targetWidth) {
+      destHeight = targetHeight;
+      destWidth = static_cast<long>(imageWidth) * targetHeight /
+                  std::max(imageHeight, 1);
+    } else {
+      destWidth = targetWidth;
+      destHeight = static_cast<long>(imageHeight) * targetWidth /
+                   std::max(imageWidth, 1);
+    }
+    destX += (targetWidth - destWidth) / 2;
+    destY += (targetHeight - destHeight) / 2;
+  }
+
+  // the size of the pixels that the visible area is taken from
+  int scaledWidth = destWidth;
+  int scaledHeight = destHeight;
+
+  if (fit == imageFit::crop) {
+    destWidth = std::min(destWidth - srcX, targetWidth);
+    destHeight = std::min(destHeight - srcY, targetHeight);
+  }
+
+  return imagePlacement{srcX,      srcY,       destX,       destY,
+                        destWidth, destHeight, scaledWidth, scaledHeight};
+}
+
+/**
+\internal
+\brief the function draws the current image into the targetArea. When the
+drawImage requests a fit or stretch, the image is scaled using the scaled
+variants held within the imageCache of the image. An exact sized entry is
+simply copied while a mip level is resampled directly into the offscreen
+buffer. When cropping, the top left of the src rectangle selects the portion
+of the image that is drawn. Tiled images are always cropped, only the tiles
+which intersect the visible area are decoded. An svg is drawn from a raster
+made at the drawn size, its natural size is the document size multiplied by
+the device scale. A scaling transform scales the natural size, other
+transforms are drawn by renderImageTransformed. Tiled images are only moved.
+*/
+void uxdevice::platform::renderImage(const drawImage &di) {
+  if (!m_transform.isAxisAligned() && !m_imageTiles) {
+    renderImageTransformed(di);
+    return;
+  }
+
+  imageFit fit = m_imageTiles || !di.fit ? imageFit::crop : *di.fit;
+  bool bVector = m_imagePixels->isVector();
+  bool bScaled = !m_imageTiles && (m_transform.xx != 1.0 ||
+                                   m_transform.yy != 1.0);
+
+  // drawing restores evicted pixels
+  if (m_imagePixels->evicted()) {
+    std::lock_guard<std::mutex> lock(m_imageMemoryMutex);
+    m_imageMemory.restores++;
+  }
+  m_imagePixels->touch();
+
+  const imagePlacement place =
+      placeImage(di, m_targetArea, *m_imagePixels, m_imageTiles,
+                 m_transform.xx, m_transform.yy);
+  const int srcX = place.srcX;
+  const int srcY = place.srcY;
+  const int destX = place.destX;
+  const int destY = place.destY;
+  const int scaledWidth = place.scaledWidth;
+  const int scaledHeight = place.scaledHeight;
+
+  if (place.destWidth <= 0 || place.destHeight <= 0)
+    return;
+
+  // clip against the target area and the window
+  const rectangle &clip = m_surface.clipArea();
+  int x1 = std::max(destX, clip.x1);
+  int y1 = std::max(destY, clip.y1);
+  int x2 = std::min(destX + place.destWidth, clip.x2);
+  int y2 = std::min(destY + place.destHeight, clip.y2);
+  if (x1 >= x2 || y1 >= y2)
+    return;
+
+  if (m_imageTiles) {
+    // the visible area in image coordinates, copied tile by tile.
+    int ix1 = x1 - destX + srcX;
+    int iy1 = y1 - destY + srcY;
+    int ix2 = x2 - destX + srcX;
+    int iy2 = y2 - destY + srcY;
+    const int size = tiledImage::tileSize;
+
+    for (int ty = iy1 / size; ty * size < iy2; ty++) {
+      for (int tx = ix1 / size; tx * size < ix2; tx++) {
+        const imageBuffer &tile = m_imageTiles->tile(tx, ty);
+        int cx1 = std::max(ix1, tx * size);
+        int cy1 = std::max(iy1, ty * size);
+        int cx2 = std::min(ix2, tx * size + tile.width);
+        int cy2 = std::min(iy2, ty * size + tile.height);
+        m_surface.copy(x1 + cx1 - ix1, y1 + cy1 - iy1, tile, cx1 - tx * size,
+                       cy1 - ty * size, cx2 - cx1, cy2 - cy1);
+      }
+    }
+
+  } else {
+    // an exact entry is copied, otherwise the returned mip level or
+    // raster is resampled.
+    const imageBuffer &scaled =
+        fit == imageFit::crop && !bVector && !bScaled
+            ? m_imagePixels->source()
+            : m_imagePixels->lookup(scaledWidth, scaledHeight);
+    bool bResample =
+        scaled.width != scaledWidth || scaled.height != scaledHeight;
+
+    if (bResample) {
+      resampleBilinear(scaled, scaledWidth, scaledHeight, x1 - destX + srcX,
+                       y1 - destY + srcY, x2 - destX + srcX,
+                       y2 - destY + srcY, m_surface.row(y1) + x1 * 4,
+                       m_surface.stride);
+    } else {
+      m_surface.copy(x1, y1, scaled, x1 - destX + srcX, y1 - destY + srcY,
+                     x2 - x1, y2 - y1);
+    }
+  }
+}
+
+/**
+\internal
+\brief draws the current image with a transform that rotates, shears or
+flips it. The image is placed within the untransformed target area as it
+would be without the transform. Each row of the bounds of the transformed
+image is limited to the span of pixels that map within the image, which is
+then sampled along a line. The pixels are taken from the cached size
+nearest to the size drawn, so reductions sample a mip level.
+*/
+void uxdevice::platform::renderImageTransformed(const drawImage &di) {
+  // drawing restores evicted pixels
+  if (m_imagePixels->evicted()) {
+    std::lock_guard<std::mutex> lock(m_imageMemoryMutex);
+    m_imageMemory.restores++;
+  }
+  m_imagePixels->touch();
+
+  const double det = m_transform.xx * m_transform.yy -
+                     m_transform.xy * m_transform.yx;
+  if (det == 0.0)
+    return;
+
+  const imagePlacement place =
+      placeImage(di, m_localArea, *m_imagePixels, nullptr);
+  if (place.destWidth <= 0 || place.destHeight <= 0)
+    return;
+
+  const rectangle &clip = m_surface.clipArea();
+  const rectangle bounds = intersectRectangle(
+      m_transform.map(rectangle(place.destX, place.destY,
+                                place.destX + place.destWidth,
+                                place.destY + place.destHeight)),
+      clip);
+  if (bounds.x1 >= bounds.x2 || bounds.y1 >= bounds.y2)
+    return;
+
+  const double s = std::sqrt(std::abs(det));
+  const imageBuffer &pixels = m_imagePixels->lookup(
+      std::max(static_cast<int>(std::lround(place.scaledWidth * s)), 1),
+      std::max(static_cast<int>(std::lround(place.scaledHeight * s)), 1));
+  const double kx = static_cast<double>(pixels.width) / place.scaledWidth;
+  const double ky = static_cast<double>(pixels.height) / place.scaledHeight;
+  const affine inverse = m_transform.inverse();
+
+  // the local position of the center of a pixel is a + b * x along a row.
+  auto span = [](const double a, const double b, const double lo,
+                 const double hi, int &x1, int &x2) {
+    if (b == 0.0) {
+      if (a < lo || a >= hi)
+        x2 = x1;
+      return;
+    }
+    double first = (lo - a) / b;
+    double last = (hi - a) / b;
+    if (b < 0.0)
+      std::swap(first, last);
+    x1 = std::max(x1, static_cast<int>(std::max(std::ceil(first), -1e9)));
+    x2 = std::min(x2, static_cast<int>(std::min(std::ceil(last), 1e9)));
+  };
+
+  for (int y = bounds.y1; y < bounds.y2; y++) {
+    const double cy = y + 0.5;
+    const double px = inverse.xy * cy + inverse.x0 + inverse.xx * 0.5;
+    const double py = inverse.yy * cy + inverse.y0 + inverse.yx * 0.5;
+    int x1 = bounds.x1;
+    int x2 = bounds.x2;
+    span(px, inverse.xx, place.destX, place.destX + place.destWidth, x1, x2);
+    span(py, inverse.yx, place.destY, place.destY + place.destHeight, x1,
+         x2);
+    if (x1 >= x2)
+      continue;
+
+    // the position within the pixels, in pixel centers.
+    const double u =
+        (px + inverse.xx * x1 - place.destX + place.srcX) * kx - 0.5;
+    const double v =
+        (py + inverse.yx * x1 - place.destY + place.srcY) * ky - 0.5;
+    sampleAffine(pixels, u, v, inverse.xx * kx, inverse.yx * ky, x2 - x1,
+                 m_surface.row(y) + x1 * 4);
+  }
+}
+
+#if defined(USE_FREETYPE)
+/**
+\brief The routine returns that face ID for the cached font. This is a
+pointer to the record within the vector.
+*/
+FTC_FaceID uxdevice::platform::getFaceID(string sTextFace) {
+  FTC_FaceID faceID = nullptr;
+
+  auto it = m_faceCache.find(sTextFace);
+  if (it != m_faceCache.end()) {
+    faceID = static_cast<FTC_FaceID>(&it->second);
+  } else {
+    string sFullFontPath = getFontFilename(sTextFace);
+    faceCacheStruct faceCacheRecord{sFullFontPath,
+                                    static_cast<int>(m_faceCache.size())};
+    pair<faceCacheIterator, bool> result =
+        m_faceCache.insert({sTextFace, faceCacheRecord});
+    // A potential bug may exist when items are added while the faceID is
+    // waiting to be used.
+    if (result.second)
+      faceID = static_cast<FTC_FaceID>(&(result.first->second));
+  }
+  return faceID;
 }
 #endif // defined
+
+/**
+\internal
+\brief The function returns the width of the string according to the font
+size.
+*/
+int uxdevice::platform::measureTextWidth(const std::string &sTextFace,
+                                         const int pointSize,
+                                         const std::string &s) {
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
+  // the font cache is shared with the render thread.
+  std::lock_guard<std::mutex> lock(m_renderMutex);
+#endif
+
+#if defined(USE_FREETYPE)
+  bool bProcessedOnce = false;
+  FT_Error error;
+  FTC_ScalerRec scaler;
+  FT_Size sizeFace;
+  FT_UInt glyph_index = 0;
+  FT_UInt previous_index = 0;
+  int returnedWidth = 0;
+
+  // store a cache record for loaded fonts.
+  FTC_FaceID faceID = getFaceID(sTextFace);
+
+  // having this as a local variable
+  scaler.face_id = faceID;
+  scaler.pixel = 0;
+  scaler.height = (pointSize + fontScale) * 64;
+  scaler.width = (pointSize + fontScale) * 64;
+
+  scaler.x_res = 96;
+  scaler.y_res = 96;
+
+  // get the face
+  error = FTC_Manager_LookupSize(m_cacheManager, &scaler, &sizeFace);
+
+  if (error)
+    throw std::runtime_error("Could not retrieve font face.");
+
+  error = FT_Activate_Size(sizeFace);
+  if (error)
+    throw std::runtime_error("Could FT_Activate_Size for font.");
+
+  FT_Face face = sizeFace->face;
+
+  // iterate characters in string
+  for (auto &c : s) {
+
+    // handle special characters
+    if (c == '\t') {
+      returnedWidth += 50;
+      continue;
+    }
+
+    // get the index of the glyph
+    glyph_index = FTC_CMapCache_Lookup(m_cmapCache, faceID, 0, c);
+
+    // the kerning of a font depends on the previous character
+    // some proportional fonts provide tighter spacing which improves
+    // rendering characteristics
+    if (bProcessedOnce && FT_HAS_KERNING(face)) {
+      FT_Vector akerning;
+      error = FT_Get_Kerning(face, previous_index, glyph_index,
+                             FT_KERNING_DEFAULT, &akerning);
+      if (!error) {
+        returnedWidth += akerning.x >> 6;
+      }
+    }
+
+    int xadvance;
+
+#ifdef USE_FREETYPE_GREYSCALE_ANTIALIAS
+    // get the image
+    FTC_SBit bitmap;
+    error = FTC_SBitCache_LookupScaler(m_bitCache, &scaler, FT_LOAD_RENDER,
+                                       glyph_index, &bitmap, nullptr);
+
+    if (error)
+      continue;
+
+    xadvance = bitmap->xadvance;
+
+#elif defined USE_FREETYPE_LCD_FILTER
+    FT_Glyph aglyph;
+    FT_BitmapGlyph bitmap;
+
+    // get the image, however this is just the outline
+    error = FTC_ImageCache_LookupScaler(m_imageCache, &scaler, FT_LOAD_DEFAULT,
+                                        glyph_index, &aglyph, nullptr);
+    if (error)
+      continue;
+
+    xadvance = (aglyph->advance.x + 0x8000) >> 16;
+
+#endif
+
+    // move after render
+    returnedWidth += xadvance;
+    bProcessedOnce = true;
+    previous_index = glyph_index;
+  }
+  return returnedWidth;
+#endif // defined
 
+}
+
 /**
 \internal
-\brief The drawText function provides textual character rendering.
+\brief the function measures the height of the textFace
+\param const std::string &sTextFace the face name
+\param const int pointSize the size in point of the font
+
+*/
+int uxdevice::platform::measureFaceHeight(const std::string &sTextFace,
+                                          const int pointSize) {
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
+  // the font cache is shared with the render thread.
+  std::lock_guard<std::mutex> lock(m_renderMutex);
+#endif
+#if defined(USE_FREETYPE)
+  FT_Error error;
+  FTC_ScalerRec scaler;
+  FT_Size sizeFace;
+
+  // store a cache record for loaded fonts.
+  FTC_FaceID faceID = getFaceID(sTextFace);
+
+  // having this as a local variable
+  scaler.face_id = faceID;
+  scaler.pixel = 0;
+  scaler.height = (pointSize + fontScale) * 64;
+  scaler.width = (pointSize + fontScale) * 64;
+
+  scaler.x_res = 96;
+  scaler.y_res = 96;
+
+  // get the face
+  error = FTC_Manager_LookupSize(m_cacheManager, &scaler, &sizeFace);
+
+  if (error)
+    throw std::runtime_error("Could not retrieve font face.");
+
+  error = FT_Activate_Size(sizeFace);
+  if (error)
+    throw std::runtime_error("Could FT_Activate_Size for font.");
+
+  FT_Face face = sizeFace->face;
+
+  // get the height of the font
+  int faceHeight = face->size->metrics.height >> 6;
+  return static_cast<int>(faceHeight);
+#endif // defined
+
+}
+
+/**
+  \internal
+  \brief the function draws the cursor.
+  */
+void uxdevice::platform::drawCaret(const int x, const int y, const int h) {
+  m_surface.fill(rectangle(x, y, x + 1, y + h), 0xFF000000);
+}
+
+/**
+\internal
+\brief the function clears the dirty rectangles of the off screen buffer.
+*/
+void uxdevice::platform::clear(void) {
+  m_surface.clear(0xFFFFFFFF);
+
+  m_xpos = 0;
+  m_ypos = 0;
+}
+
+/**
+\brief The function provides the reallocation of the offscreen buffer
+
+*/
+void uxdevice::platform::resize(const int w, const int h) {
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
+  // the render thread may be drawing into the buffers.
+  std::lock_guard<std::mutex> renderLock(m_renderMutex);
+#endif
+
+  _w = w;
+  _h = h;
+
+#if defined(__linux__)
+  size_t _bufferSize = _w * _h * 4;
+
+  /* the segments are kept while the frame fits within them. They are
+  allocated with half again the size needed so that a window being dragged
+  larger reallocates rarely, and are reallocated smaller when the frame uses
+  less than a quarter of them. */
+  if (m_buffers.empty() || _bufferSize > m_bufferCapacity ||
+      _bufferSize < m_bufferCapacity / 4) {
+    const size_t pageSize = 4096;
+    size_t capacity = _bufferSize + _bufferSize / 2;
+    if (!m_buffers.empty() && _bufferSize > m_bufferCapacity)
+      capacity = std::max(capacity, m_bufferCapacity + m_bufferCapacity / 2);
+    capacity = (capacity + pageSize - 1) & ~(pageSize - 1);
+
+    // free old ones if they exist
+    releaseBuffers();
+
+    // Shared memory test.
+    if (m_bSharedMemory) {
+      const xcb_query_extension_reply_t *shm =
+          xcb_get_extension_data(m_connection, &xcb_shm_id);
+      xcb_shm_query_version_reply_t *reply =
+          shm && shm->present
+              ? xcb_shm_query_version_reply(
+                    m_connection, xcb_shm_query_version(m_connection), NULL)
+              : nullptr;
+      if (reply)
+        m_shmCompletion = shm->first_event + XCB_SHM_COMPLETION;
+      else
+        m_bSharedMemory = false;
+      free(reply);
+    }
+
+    std::lock_guard<std::mutex> lock(m_bufferMutex);
+    m_buffers.resize(SCREEN_BUFFERS);
+    for (size_t i = 0; m_bSharedMemory && i < m_buffers.size(); i++) {
+      if (!attachBuffer(i, capacity)) {
+        for (size_t j = 0; j < i; j++) {
+          xcb_shm_detach(m_connection, m_buffers[j].info.shmseg);
+          shmdt(m_buffers[j].info.shmaddr);
+        }
+        m_bSharedMemory = false;
+      }
+    }
+
+    // remote servers and containers without shared ipc receive the frames
+    // within the requests.
+    if (!m_bSharedMemory) {
+      m_maxRequestBytes =
+          static_cast<size_t>(xcb_get_maximum_request_length(m_connection)) *
+          4;
+      for (auto &buffer : m_buffers) {
+        buffer.local.resize(capacity);
+        buffer.info.shmaddr = buffer.local.data();
+        buffer.info.shmseg = 0;
+      }
+    }
 
-\param std::string
-Optimized Blend
-https://www.codeguru.com/cpp/cpp/algorithms/general/article.php/c15989/Tip-An-Optimized-Formula-for-Alpha-Blending-Pixels.htm
+    for (auto &buffer : m_buffers)
+      buffer.bBusy = false;
+    m_bufferCapacity = capacity;
+    m_backBuffer = 0;
+  }
 
-*/
-void uxdevice::platform::activateTextFace(void) {
-#if defined(USE_FREETYPE)
-  // store a cache record for loaded fonts.
-  m_faceID = getFaceID(*m_textFace);
+  // the layout of the pixels changed, the next frame is presented whole.
+  m_bPresented = false;
+  m_damage.clear();
+  m_presented.clear();
 
-  // having this as a local variable
-  m_scaler.face_id = m_faceID;
-  m_scaler.pixel = 0;
-  m_scaler.height = (*m_pointSize + fontScale) * 64;
-  m_scaler.width = (*m_pointSize + fontScale) * 64;
+  m_surface = surface(m_buffers[m_backBuffer].info.shmaddr, _w, _h, _w * 4);
 
-  m_scaler.x_res = 96;
-  m_scaler.y_res = 96;
+  // clear to white
+  clear();
 
-  // get the face
-  m_error = FTC_Manager_LookupSize(m_cacheManager, &m_scaler, &m_sizeFace);
+#elif defined(_WIN64)
+  // get the size ofthe window
+  RECT rc;
+  GetClientRect(m_hwnd, &rc);
 
-  if (m_error)
-    throw std::runtime_error("Could not retrieve font face.");
+  // resize the pixel memory
+  _w = rc.right - rc.left;
+  _h = rc.bottom - rc.top;
 
-  m_error = FT_Activate_Size(m_sizeFace);
-  if (m_error)
-    throw std::runtime_error("Could FT_Activate_Size for font.");
-  m_faceHeight = m_sizeFace->face->size->metrics.height >> 6;
+  int _bufferSize = _w * _h * 4;
 
-#endif // defined
+  m_offscreenStorage.resize(_bufferSize);
+  m_surface = surface(m_offscreenStorage.data(), _w, _h, _w * 4);
 
+  // clear to white
+  clear();
+
+  // free existing resources
+  if (m_pRenderTarget) {
+    m_pRenderTarget->Resize(D2D1::SizeU(_w, _h));
+
+  } else {
+
+    // Create a Direct2D render target
+    HRESULT hr = m_pD2DFactory->CreateHwndRenderTarget(
+        D2D1::RenderTargetProperties(),
+        D2D1::HwndRenderTargetProperties(m_hwnd, D2D1::SizeU(_w, _h)),
+        &m_pRenderTarget);
+    if (FAILED(hr))
+      return;
+  }
+#endif
 }
 
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
 /**
 \internal
-\brief The drawText function provides textual character rendering.
-
-\param std::string
-Optimized Blend
-https://www.codeguru.com/cpp/cpp/algorithms/general/article.php/c15989/Tip-An-Optimized-Formula-for-Alpha-Blending-Pixels.htm
-
+\brief The function compares a frame with the previous one in blocks of
+PRESENT_DAMAGE_TILE pixels. Runs of changed blocks within a row of blocks
+become rectangles, a rectangle is extended downward when the row below
+changed over the same columns. The rectangles are appended to damage.
 */
-#if defined(USE_FREETYPE)
-void uxdevice::platform::renderText(const std::size_t &beginIndex,
-                                    const std::size_t &endIndex) {
+static void frameDamage(const u_int8_t *frame, const u_int8_t *previous,
+                        const int w, const int h,
+                        std::vector<rectangle> &damage) {
+  const int tile = PRESENT_DAMAGE_TILE;
+  const size_t stride = static_cast<size_t>(w) * 4;
+  const int columns = (w + tile - 1) / tile;
+  vector<bool> changed(columns);
+
+  // the rectangles which end at the top of the current row of blocks
+  vector<size_t> open, extended;
+
+  for (int ty = 0; ty < h; ty += tile) {
+    int rows = std::min(tile, h - ty);
+    for (int tx = 0; tx < columns; tx++) {
+      size_t offset = ty * stride + tx * tile * 4;
+      size_t bytes = std::min(tile, w - tx * tile) * 4;
+      changed[tx] = false;
+      for (int y = 0; y < rows && !changed[tx]; y++, offset += stride)
+        changed[tx] = memcmp(frame + offset, previous + offset, bytes) != 0;
+    }
 
-  // set the text pen rendering position
-  m_xpos = m_targetArea->x1;
-  m_ypos = m_targetArea->y1;
+    extended.clear();
+    for (int tx = 0; tx < columns;) {
+      if (!changed[tx]) {
+        tx++;
+        continue;
+      }
+      int x1 = tx * tile;
+      while (tx < columns && changed[tx])
+        tx++;
+      int x2 = std::min(tx * tile, w);
 
-  m_bProcessedOnce = false;
+      auto above = find_if(open.begin(), open.end(), [&](size_t i) {
+        return damage[i].x1 == x1 && damage[i].x2 == x2;
+      });
+      if (above != open.end()) {
+        damage[*above].y2 = ty + rows;
+        extended.push_back(*above);
+      } else {
+        damage.emplace_back(x1, ty, x2, ty + rows);
+        extended.push_back(damage.size() - 1);
+      }
+    }
+    open.swap(extended);
+  }
+}
 
-  // iterate characters in string
-  for (std::size_t idx = beginIndex; idx < endIndex; idx++) {
+/**
+\internal
+\brief The function merges rectangles to limit the number of requests.
+Two rectangles are merged when their bounds cover little more than the
+rectangles do, or, while there are more than PRESENT_DAMAGE_RECTS, the two
+whose bounds waste the least area are merged.
+*/
+static void mergeDamage(std::vector<rectangle> &damage) {
+  auto area = [](const rectangle &r) {
+    return static_cast<long>(r.x2 - r.x1) * (r.y2 - r.y1);
+  };
+  auto bounds = [](const rectangle &a, const rectangle &b) {
+    return rectangle(std::min(a.x1, b.x1), std::min(a.y1, b.y1),
+                     std::max(a.x2, b.x2), std::max(a.y2, b.y2));
+  };
+  const long slack = PRESENT_DAMAGE_TILE * PRESENT_DAMAGE_TILE;
+
+  // too many to compare in pairs, the bounds of all are presented.
+  if (damage.size() > PRESENT_DAMAGE_RECTS * 4) {
+    rectangle all = damage.front();
+    for (auto &r : damage)
+      all = bounds(all, r);
+    damage.assign(1, all);
+    return;
+  }
 
-    // exit when rectangle has been filled
-    if (m_ypos > m_targetArea->y2)
+  while (damage.size() > 1) {
+    size_t a = 0, b = 0;
+    long leastWaste = std::numeric_limits<long>::max();
+    for (size_t i = 0; i < damage.size(); i++)
+      for (size_t j = i + 1; j < damage.size(); j++) {
+        long waste = area(bounds(damage[i], damage[j])) - area(damage[i]) -
+                     area(damage[j]);
+        if (waste < leastWaste) {
+          leastWaste = waste;
+          a = i;
+          b = j;
+        }
+      }
+
+    if (leastWaste > slack && damage.size() <= PRESENT_DAMAGE_RECTS)
       break;
 
-    renderChar((*m_stringData)[idx]);
+    damage[a] = bounds(damage[a], damage[b]);
+    damage.erase(damage.begin() + b);
   }
 }
 
+#endif
+
 /**
 \internal
-\brief The function provides the rendering of a individual character
-\details
-The routine provides the individual rendering of a character.
+\brief requests a frame. Several requests between vertical blanks produce
+a single frame. With the present extension, the server is asked to notify
+the next vertical blank and the frame is drawn when it does.
+*/
+void uxdevice::platform::requestFrame(void) {
+#if defined(__linux__)
+  m_bFrameRequested = true;
+  if (m_bPresentPacing && !m_bMscPending) {
+    xcb_present_notify_msc(m_connection, m_window, ++m_presentSerial, 0, 1, 0);
+    xcb_flush(m_connection);
+    m_bMscPending = true;
+    m_mscTime = std::chrono::steady_clock::now();
+  }
+#elif defined(_WIN64)
+  dispatchEvent(event{eventType::paint});
+#endif
+}
 
-Special
-characters such as escape characters are filtered.
+/**
+\brief The function presents the pixel buffer on the screen. The frame was
+drawn directly into a shared memory buffer. The buffer is handed to the
+server and drawing continues in the next buffer once the server has
+finished reading it. Only the damage, the areas the caller knows differ
+from the frame on the screen, is presented. Without it, the frame is
+compared with the one on the screen to find them.
+*/
+void uxdevice::platform::flip(
+    const std::optional<std::vector<rectangle>> &damage) {
+#if defined(__linux__)
+  shmBuffer &buffer = m_buffers[m_backBuffer];
+
+  // only the areas that differ from the frame on the screen are presented.
+  if (m_bPresented && damage) {
+    m_damage.insert(m_damage.end(), damage->begin(), damage->end());
+  } else if (m_bPresented) {
+    const shmBuffer &front =
+        m_buffers[(m_backBuffer + m_buffers.size() - 1) % m_buffers.size()];
+    frameDamage(buffer.info.shmaddr, front.info.shmaddr, _w, _h, m_damage);
+  } else {
+    m_damage.assign(1, rectangle(0, 0, _w, _h));
+  }
 
+  // an unchanged frame leaves the back buffer equal to the front buffer.
+  if (m_damage.empty()) {
+    m_presented.clear();
+    return;
+  }
+  presented(m_damage);
 
-\param const char c is the individual character
+  present(m_backBuffer, m_damage);
+  m_bPresented = true;
+  swapBuffers();
 
-*/
-int uxdevice::platform::renderChar(const char c) {
-  FT_Error error;
-  unsigned int color = 0x00; // computed color
-  int x, y;
-  const int CtabStap = 50;
+#elif defined(_WIN64)
+  if (!m_pRenderTarget)
+    return;
 
-  // handle special characters
-  // new line
-  switch (c) {
-  case '\n':
-    m_xpos = m_targetArea->x1;
-    m_ypos += m_faceHeight;
-    return 0;
-    break;
-  case '\t':
-    m_xpos += CtabStap;
-    return CtabStap;
-    break;
-  }
+  m_pRenderTarget->BeginDraw();
 
-  // get the index of the glyph
-  m_glyph_index = FTC_CMapCache_Lookup(m_cmapCache, m_faceID, 0, c);
-  FT_Face face = m_sizeFace->face;
+  // create offscreen bitmap for pixel rendering
+  D2D1_PIXEL_FORMAT desc2D = D2D1::PixelFormat();
+  desc2D.format = DXGI_FORMAT_B8G8R8A8_UNORM;
+  desc2D.alphaMode = D2D1_ALPHA_MODE_IGNORE;
 
-  // the kerning of a font depends on the previous character
-  // some proportional fonts provide tighter spacing which improves
-  // rendering characteristics
-  if (m_bProcessedOnce && FT_HAS_KERNING(face)) {
-    FT_Vector akerning;
-    error = FT_Get_Kerning(face, m_previous_index, m_glyph_index,
-                           FT_KERNING_DEFAULT, &akerning);
-    if (!error) {
-      m_xpos += akerning.x >> 6;
-    }
-  }
+  D2D1_BITMAP_PROPERTIES bmpProperties = D2D1::BitmapProperties();
+  m_pRenderTarget->GetDpi(&bmpProperties.dpiX, &bmpProperties.dpiY);
+  bmpProperties.pixelFormat = desc2D;
 
-  // get the height of the font
-  int baseline = face->size->metrics.ascender >> 6;
+  RECT rc;
+  GetClientRect(m_hwnd, &rc);
 
-  /**
-  \brief use greyscale or color lcd filtering
-\details
-      There are two distinct types of bimap structures that are in use, grey
-      scale or lcd filtered. The buffer format is unique for each, the grey
-  lite one being a value indicating grey luminence while the lcd filter is a
-  rgb one. These values provide the same functionality for the looping and
-      drawing routine. You will notice that within each block of code, after
-      getting the image, these values are set.
-  */
-  int storageSize, pitch, top, left, height, width, xadvance;
-  unsigned char *buffer;
+  D2D1_SIZE_U size = D2D1::SizeU(_w, _h);
+  HRESULT hr = m_pRenderTarget->CreateBitmap(
+      size, m_surface.pixels, m_surface.stride, &bmpProperties, &m_pBitmap);
 
-#ifdef USE_FREETYPE_GREYSCALE_ANTIALIAS
-  // get the image
-  FTC_SBit bitmap;
-  error = FTC_SBitCache_LookupScaler(m_bitCache, &m_scaler, FT_LOAD_RENDER,
-                                     m_glyph_index, &bitmap, nullptr);
+  // render bitmap to screen
+  D2D1_RECT_F rectf;
+  rectf.left = 0;
+  rectf.top = 0;
+  rectf.bottom = _h;
+  rectf.right = _w;
 
-  if (error)
-    return 0;
+  m_pRenderTarget->DrawBitmap(m_pBitmap, rectf, 1.0f,
+                              D2D1_BITMAP_INTERPOLATION_MODE_NEAREST_NEIGHBOR);
 
-  // set the rendering values used for grey
-  storageSize = 1;
-  pitch = bitmap->pitch;
-  top = bitmap->top;
-  left = bitmap->left;
-  height = bitmap->height;
-  width = bitmap->width;
-  buffer = bitmap->buffer;
-  xadvance = bitmap->xadvance;
+  m_pRenderTarget->EndDraw();
+  m_pBitmap->Release();
 
-#elif defined (USE_FREETYPE_LCD_FILTER)
-  FT_Glyph aglyph;
-  FT_BitmapGlyph bitmap;
+#endif
+}
 
-  // get the image, however this is just the outline
-  error = FTC_ImageCache_LookupScaler(m_imageCache, &m_scaler, FT_LOAD_DEFAULT,
-                                      m_glyph_index, &aglyph, nullptr);
-  if (error)
-    return 0;
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
+/**
+\internal
+\brief presents the damaged areas of the buffer at index, clipped to the
+window, and clears damage. Only the last request asks for a completion
+event, the server handles the requests in order.
+*/
+void uxdevice::platform::present(const std::size_t index,
+                                 std::vector<rectangle> &damage) {
+  shmBuffer &buffer = m_buffers[index];
+  for (auto &r : damage) {
+    r.x1 = std::max(r.x1, 0);
+    r.y1 = std::max(r.y1, 0);
+    r.x2 = std::min(r.x2, static_cast<int>(_w));
+    r.y2 = std::min(r.y2, static_cast<int>(_h));
+  }
+  damage.erase(std::remove_if(damage.begin(), damage.end(),
+                              [](const rectangle &r) {
+                                return r.x1 >= r.x2 || r.y1 >= r.y2;
+                              }),
+               damage.end());
+  mergeDamage(damage);
+
+  if (!m_bSharedMemory) {
+    for (auto &r : damage)
+      putImage(index, r);
+    xcb_flush(m_connection);
+    damage.clear();
+    return;
+  }
 
-  xadvance = (aglyph->advance.x + 0x8000) >> 16;
+  for (size_t i = 0; i < damage.size(); i++) {
+    const rectangle &r = damage[i];
+    xcb_shm_put_image(m_connection, m_window, m_graphics, _w, _h, r.x1, r.y1,
+                      r.x2 - r.x1, r.y2 - r.y1, r.x1, r.y1,
+                      m_screen->root_depth, XCB_IMAGE_FORMAT_Z_PIXMAP,
+                      i + 1 == damage.size(), buffer.info.shmseg, 0);
+  }
+  if (!damage.empty()) {
+    std::lock_guard<std::mutex> lock(m_bufferMutex);
+    buffer.bBusy = true;
+  }
 
-  // this converts the outline image to a rgb bitmap
-  error = FT_Glyph_To_Bitmap(&aglyph, FT_RENDER_MODE_LCD, 0, 0);
-  bitmap = reinterpret_cast<FT_BitmapGlyph>(aglyph);
+  xcb_flush(m_connection);
+  damage.clear();
+}
 
-  // set the rendering values used for for grey
-  storageSize = 3;
-  pitch = bitmap->bitmap.pitch;
-  top = bitmap->top;
-  left = bitmap->left;
-  height = bitmap->bitmap.rows;
-  width = bitmap->bitmap.width;
-  buffer = bitmap->bitmap.buffer;
+/**
+\internal
+\brief makes the presented buffer the front buffer and draws the next
+frame into the other one.
+*/
+void uxdevice::platform::swapBuffers(void) {
+  {
+    std::lock_guard<std::mutex> lock(m_bufferMutex);
+    m_backBuffer = (m_backBuffer + 1) % m_buffers.size();
+  }
 
-#endif
+  // the render thread acquires the buffer before drawing the next frame.
+  if (std::this_thread::get_id() != m_renderThread.get_id())
+    acquireBuffer();
+}
 
-  x = m_xpos;
-  y = m_ypos + baseline - top;
+/**
+\internal
+\brief produces a frame in which the pixels of move.area are moved by dx,
+dy. The back buffer is brought up to date with the front buffer, the pixels
+that stay visible are moved within it and only the exposed strips are drawn.
+On the screen, the server copies the moved pixels and only the strips are
+sent. Returns false when nothing has been presented yet or when the move
+leaves no pixels in the area, the frame is then drawn whole.
+*/
+bool uxdevice::platform::scrollFrame(const displayList &list, const int scale,
+                                     const scrollMove &move) {
+  const int dx = move.dx;
+  const int dy = move.dy;
+  rectangle area(std::max(move.area.x1, 0), std::max(move.area.y1, 0),
+                 std::min(move.area.x2, static_cast<int>(_w)),
+                 std::min(move.area.y2, static_cast<int>(_h)));
+  rectangle moved(area.x1 + std::max(dx, 0), area.y1 + std::max(dy, 0),
+                  area.x2 + std::min(dx, 0), area.y2 + std::min(dy, 0));
+
+  if (!m_bPresented || (!dx && !dy) || moved.x1 >= moved.x2 ||
+      moved.y1 >= moved.y2)
+    return false;
+
+  const size_t stride = static_cast<size_t>(_w) * 4;
+  const u_int8_t *from =
+      m_buffers[(m_backBuffer + m_buffers.size() - 1) % m_buffers.size()]
+          .info.shmaddr;
+  u_int8_t *to = m_buffers[m_backBuffer].info.shmaddr;
+
+  syncBackBuffer();
+
+  for (int y = moved.y1; y < moved.y2; y++)
+    memcpy(to + y * stride + moved.x1 * 4,
+           from + (y - dy) * stride + (moved.x1 - dx) * 4,
+           (moved.x2 - moved.x1) * 4);
+
+  // the parts of the area that the pixels moved away from.
+  std::vector<rectangle> strips;
+  if (moved.y1 > area.y1)
+    strips.emplace_back(area.x1, area.y1, area.x2, moved.y1);
+  if (moved.y2 < area.y2)
+    strips.emplace_back(area.x1, moved.y2, area.x2, area.y2);
+  if (moved.x1 > area.x1)
+    strips.emplace_back(area.x1, moved.y1, moved.x1, moved.y2);
+  if (moved.x2 < area.x2)
+    strips.emplace_back(moved.x2, moved.y1, area.x2, moved.y2);
+
+  for (auto &strip : strips) {
+    m_surface.limit(strip);
+    m_surface.fill(strip, 0xFFFFFFFF);
+    m_xpos = 0;
+    m_ypos = 0;
+    render(list, scale);
+  }
+  m_surface.limit(rectangle(0, 0, _w, _h));
+
+  xcb_copy_area(m_connection, m_window, m_window, m_graphics, moved.x1 - dx,
+                moved.y1 - dy, moved.x1, moved.y1, moved.x2 - moved.x1,
+                moved.y2 - moved.y1);
+
+  std::vector<rectangle> changed = strips;
+  changed.push_back(moved);
+  presented(changed);
+  m_damage.insert(m_damage.end(), strips.begin(), strips.end());
+  present(m_backBuffer, m_damage);
+  swapBuffers();
+  return true;
+}
 
-  // calculate the maximum bounds
-  int xmax = x + width / storageSize + left;
-  int ymax = m_ypos + (baseline - top) + height;
-
-  // if the maximum bounds are greater than the clipping region, adjust.
-  if (xmax > m_targetArea->x2)
-    xmax = m_targetArea->x2;
-  if (ymax > m_targetArea->y2)
-    ymax = m_targetArea->y2;
-
-  // loop through the pixels
-  for (int i = x + left, p = 0; i < xmax; i++, p += storageSize) {
-    for (int j = y, q = 0; j < ymax; j++, q++) {
-      int bufferPosition = q * pitch + p;
-
-      /* only plot active pixels, the term
-       luminance is used because it is not actually a color
-       but a brightness of the pixel. Zero being off for the
-       glyph bitmap. */
-#ifdef USE_FREETYPE_GREYSCALE_ANTIALIAS
-      if (buffer[bufferPosition]) {
-#elif defined USE_FREETYPE_LCD_FILTER
-      if (buffer[bufferPosition] || buffer[bufferPosition + 1] ||
-          buffer[bufferPosition + 2]) {
+/**
+\internal
+\brief records the areas presented with a frame. The areas of the frames
+the back buffer has not seen are kept, one frame fewer than there are
+buffers.
+*/
+void uxdevice::platform::presented(const std::vector<rectangle> &areas) {
+  m_presented.push_front(areas);
+  while (m_presented.size() > std::max<std::size_t>(m_buffers.size(), 2) - 1)
+    m_presented.pop_back();
+}
 
-#endif
-
-#if defined(USE_IMAGE_MAGICK)
-        Magick::Color destinationC = getPixel(i, j);
-
-        unsigned char destinationR = destinationC.quantumRed() / QuantumRange * 255;
-        unsigned char destinationG = destinationC.quantumGreen() / QuantumRange * 255;
-        unsigned char destinationB = destinationC.quantumBlue() / QuantumRange * 255;
-
-#else
-        unsigned int destinationC = getPixel(i, j);
-        unsigned char destinationR = destinationC >> 16;
-        unsigned char destinationG = destinationC >> 8;
-        unsigned char destinationB = destinationC;
-#endif // defined
+/**
+\internal
+\brief the back buffer holds the frame drawn SCREEN_BUFFERS - 1 frames
+before the one on the screen. The areas presented with the frames since
+are copied from the front buffer so that the back buffer may be drawn in
+part.
+*/
+void uxdevice::platform::syncBackBuffer(void) {
+  const size_t stride = static_cast<size_t>(_w) * 4;
+  const u_int8_t *from =
+      m_buffers[(m_backBuffer + m_buffers.size() - 1) % m_buffers.size()]
+          .info.shmaddr;
+  u_int8_t *to = m_buffers[m_backBuffer].info.shmaddr;
+
+  for (auto &frame : m_presented) {
+    for (auto &r : frame) {
+      int x1 = std::max(r.x1, 0);
+      int x2 = std::min(r.x2, static_cast<int>(_w));
+      for (int y = std::max(r.y1, 0);
+           y < std::min(r.y2, static_cast<int>(_h)) && x1 < x2; y++)
+        memcpy(to + y * stride + x1 * 4, from + y * stride + x1 * 4,
+               (x2 - x1) * 4);
+    }
+  }
+}
 
+/**
+\internal
+\brief draws the areas of damage, leaving the rest of the frame on the
+screen. Returns false when the frame is better drawn as a whole, when none
+was presented or the damage covers half of the window.
+*/
+bool uxdevice::platform::damageFrame(const displayList &list, const int scale,
+                                     std::vector<rectangle> damage) {
+  if (!m_bPresented)
+    return false;
+
+  // clip to the window, the areas are merged where they overlap.
+  std::size_t pixels = 0;
+  std::vector<rectangle> areas;
+  for (auto &r : damage) {
+    rectangle a(std::max(r.x1, 0), std::max(r.y1, 0),
+                std::min(r.x2, static_cast<int>(_w)),
+                std::min(r.y2, static_cast<int>(_h)));
+    if (a.x1 < a.x2 && a.y1 < a.y2)
+      areas.push_back(a);
+  }
+  mergeDamage(areas);
+  for (auto &a : areas)
+    pixels += static_cast<size_t>(a.x2 - a.x1) * (a.y2 - a.y1);
+  if (pixels * 2 > static_cast<size_t>(_w) * _h)
+    return false;
+
+  // nothing to draw, exposed areas still queued are sent from the frame on
+  // the screen.
+  if (areas.empty()) {
+    if (!m_damage.empty())
+      present((m_backBuffer + m_buffers.size() - 1) % m_buffers.size(),
+              m_damage);
+    return true;
+  }
 
-#if defined(USE_FREETYPE_GREYSCALE_ANTIALIAS)
-        // luminescence is expressed in gray scale using one byte
-        unsigned char freetypeColor = buffer[bufferPosition];
-        unsigned char freetypeR = freetypeColor;
-        unsigned char freetypeG = freetypeColor;
-        unsigned char freetypeB = freetypeColor;
+  syncBackBuffer();
+  for (auto &a : areas) {
+    m_surface.limit(a);
+    m_surface.fill(a, 0xFFFFFFFF);
+    m_xpos = 0;
+    m_ypos = 0;
+    render(list, scale);
+  }
+  m_surface.limit(rectangle(0, 0, _w, _h));
 
-#elif defined(USE_FREETYPE_LCD_FILTER)
-        // luminescence is expressed within the LCD format as three bytes.
-        unsigned char freetypeR = buffer[bufferPosition];
-        unsigned char freetypeG = buffer[bufferPosition + 1];
-        unsigned char freetypeB = buffer[bufferPosition + 2];
-#endif
+  presented(areas);
+  m_damage.insert(m_damage.end(), areas.begin(), areas.end());
+  present(m_backBuffer, m_damage);
+  swapBuffers();
+  return true;
+}
 
-        unsigned char targetR =
-            ((m_textColorR * freetypeR) + (destinationR * (255 - freetypeR))) >>
-            8;
-        unsigned char targetG =
-            ((m_textColorG * freetypeG) + (destinationG * (255 - freetypeG))) >>
-            8;
-        unsigned char targetB =
-            ((m_textColorB * freetypeB) + (destinationB * (255 - freetypeB))) >>
-            8;
-
-        color = ((targetR) << 16) | ((targetG) << 8) | (targetB);
-#if defined(USE_IMAGE_MAGICK)
-        Magick::Color mgColor(targetR/255.0*QuantumRange,targetG/255.0*QuantumRange,targetB/255.0*QuantumRange);
-        putPixel(i, j, mgColor);
-#else
-        // place the computed color into pixel buffer
-        putPixel(i, j, color);
-#endif
-      }
+/**
+\internal
+\brief sends the area r of the buffer at index, held in local memory. The rows are
+sent in as many put image requests as the maximum request length requires.
+The requests are not checked so no round trips are made. Areas narrower
+than the window are packed first.
+*/
+void uxdevice::platform::putImage(const std::size_t index,
+                                  const rectangle &r) {
+  const shmBuffer &buffer = m_buffers[index];
+  const int width = r.x2 - r.x1;
+  const size_t rowBytes = static_cast<size_t>(width) * 4;
+  const size_t payload = m_maxRequestBytes - sizeof(xcb_put_image_request_t);
+  const int rows = static_cast<int>(std::max<size_t>(payload / rowBytes, 1));
+
+  for (int y = r.y1; y < r.y2; y += rows) {
+    const int height = std::min(rows, r.y2 - y);
+    const u_int8_t *data =
+        buffer.info.shmaddr + (static_cast<size_t>(y) * _w + r.x1) * 4;
+
+    if (width != _w) {
+      m_packBuffer.resize(rowBytes * height);
+      for (int j = 0; j < height; j++)
+        memcpy(m_packBuffer.data() + j * rowBytes,
+               data + static_cast<size_t>(j) * _w * 4, rowBytes);
+      data = m_packBuffer.data();
     }
+
+    xcb_put_image(m_connection, XCB_IMAGE_FORMAT_Z_PIXMAP, m_window,
+                  m_graphics, width, height, r.x1, y, 0,
+                  m_screen->root_depth, rowBytes * height, data);
   }
+}
 
-#ifdef USE_FREETYPE_LCD_FILTER
-  // delete the bitmap data
-  FT_Done_Glyph((FT_Glyph)bitmap);
+/**
+\internal
+\brief creates a shared memory segment of capacity bytes for the buffer
+at index and attaches it to the server. Returns false if the segment cannot be created or the server
+cannot attach it, as with remote connections.
+*/
+bool uxdevice::platform::attachBuffer(const std::size_t index,
+                                      const std::size_t capacity) {
+  shmBuffer &buffer = m_buffers[index];
+  int shmid = shmget(IPC_PRIVATE, capacity, IPC_CREAT | 0600);
+  if (shmid == -1)
+    return false;
+
+  buffer.info.shmid = shmid;
+
+  buffer.info.shmaddr = (uint8_t *)shmat(buffer.info.shmid, 0, 0);
+  if (buffer.info.shmaddr == reinterpret_cast<uint8_t *>(-1)) {
+    shmctl(buffer.info.shmid, IPC_RMID, 0);
+    return false;
+  }
 
-#endif
-  m_previous_index = m_glyph_index;
-  m_bProcessedOnce = true;
-  m_xpos += xadvance;
+  buffer.info.shmseg = xcb_generate_id(m_connection);
+  xcb_generic_error_t *error = xcb_request_check(
+      m_connection, xcb_shm_attach_checked(m_connection, buffer.info.shmseg,
+                                           buffer.info.shmid, 0));
+  shmctl(buffer.info.shmid, IPC_RMID, 0);
+  if (error) {
+    free(error);
+    shmdt(buffer.info.shmaddr);
+    return false;
+  }
 
-  return xadvance;
+  return true;
 }
-#endif
 
-void uxdevice::platform::renderImage(const rectangle &src) {
-  int clampedWidth = 0;
-  int clampedHeight = 0;
+/**
+\internal
+\brief waits until the server has finished reading the back buffer. Other
+events received while waiting are kept for the message loop.
+*/
+void uxdevice::platform::acquireBuffer(void) {
+  // the render thread is woken by the event thread as completions arrive.
+  if (std::this_thread::get_id() == m_renderThread.get_id()) {
+    std::unique_lock<std::mutex> lock(m_bufferMutex);
+    m_bufferAvailable.wait(lock, [this] {
+      return m_bRenderExit || m_buffers.empty() ||
+             !m_buffers[m_backBuffer].bBusy;
+    });
+    return;
+  }
 
-  int targetWidth = m_targetArea->x2 - m_targetArea->x1;
-  int targetHeight = m_targetArea->y2 - m_targetArea->y1;
+  while (m_buffers[m_backBuffer].bBusy) {
+    xcb_generic_event_t *xcbEvent = xcb_wait_for_event(m_connection);
+    if (!xcbEvent)
+      break;
 
-#if defined(USE_STB_IMAGE)
-  int destX, destY;
-  if (*m_width > targetWidth) {
-    clampedWidth = targetWidth;
-  } else {
-    clampedWidth = *m_width;
-  }
-  if (*m_height > targetHeight) {
-    clampedHeight = targetHeight;
-  } else {
-    clampedHeight = *m_height;
+    if (completion(xcbEvent)) {
+      free(xcbEvent);
+    } else {
+      m_pendingEvents.push_back(xcbEvent);
+      m_bCoalesced = false;
+    }
   }
-  for (int j = 0; j < clampedHeight; j++) {
-    for (int i = 0; i < clampedWidth; i++) {
-      destX = m_targetArea->x1 + i;
-      destY = m_targetArea->y1 + j;
-
-      size_t bufferPos = i * 4 + j * 4 * (*m_width);
-      unsigned int *p =
-          reinterpret_cast<unsigned int *>(&(*m_imageData)[bufferPos]);
-      putPixel(destX, destY, *p);
-
-    }
-  }
 
-#elif defined(USE_IMAGE_MAGICK)
-  if (m_image->columns() > targetWidth) {
-    clampedWidth = targetWidth;
-  } else {
-    clampedWidth = m_image->columns();
+  m_surface.pixels = m_buffers[m_backBuffer].info.shmaddr;
+}
+
+/**
+\internal
+\brief marks the buffer named by a shared memory completion event as
+available. Returns false if the event is not a completion event.
+*/
+bool uxdevice::platform::completion(xcb_generic_event_t *xcbEvent) {
+  if (!m_bSharedMemory || (xcbEvent->response_type & ~0x80) != m_shmCompletion)
+    return false;
+
+  xcb_shm_completion_event_t *complete =
+      reinterpret_cast<xcb_shm_completion_event_t *>(xcbEvent);
+  {
+    std::lock_guard<std::mutex> lock(m_bufferMutex);
+    for (auto &buffer : m_buffers)
+      if (buffer.info.shmseg == complete->shmseg)
+        buffer.bBusy = false;
   }
-  if (m_image->rows() > targetHeight) {
-    clampedHeight = targetHeight;
-  } else {
-    clampedHeight = m_image->rows();
-  }
-
-  m_image->crop(Magick::Geometry(clampedWidth,clampedHeight));
-  m_offscreenImage.composite(*m_image,m_targetArea->x1,
-                              m_targetArea->y1,
-                              Magick::CompositeOperator::CopyCompositeOp);
-#endif
+  m_bufferAvailable.notify_one();
 
+  return true;
+}
 
+/**
+\internal
+\brief returns true when events are waiting to be handled. An event read
+from the connection is kept for the message loop.
+*/
+bool uxdevice::platform::eventsPending(void) {
+  if (m_pendingEvents.empty()) {
+    xcb_generic_event_t *xcbEvent = xcb_poll_for_event(m_connection);
+    if (xcbEvent) {
+      m_pendingEvents.push_back(xcbEvent);
+      m_bCoalesced = false;
+    }
+  }
+  return !m_pendingEvents.empty();
 }
-
-
-#if defined(USE_FREETYPE)
+
 /**
-\brief The routine returns that face ID for the cached font. This is a
-pointer to the record within the vector.
+\internal
+\brief reduces the batch of pending events to the ones that change the
+outcome. Of consecutive motion events only the last is kept, as is the last
+configure event of the batch. Releases of the wheel buttons are dropped so
+that consecutive wheel steps can be summed by the message loop.
 */
-FTC_FaceID uxdevice::platform::getFaceID(string sTextFace) {
-  FTC_FaceID faceID = nullptr;
+void uxdevice::platform::coalesceEvents(void) {
+  std::list<xcb_generic_event_t *> kept;
+  bool bConfigure = false;
 
-  auto it = m_faceCache.find(sTextFace);
-  if (it != m_faceCache.end()) {
-    faceID = static_cast<FTC_FaceID>(&it->second);
-  } else {
-    string sFullFontPath = getFontFilename(sTextFace);
-    faceCacheStruct faceCacheRecord{sFullFontPath,
-                                    static_cast<int>(m_faceCache.size())};
-    pair<faceCacheIterator, bool> result =
-        m_faceCache.insert({sTextFace, faceCacheRecord});
-    // A potential bug may exist when items are added while the faceID is
-    // waiting to be used.
-    if (result.second)
-      faceID = static_cast<FTC_FaceID>(&(result.first->second));
+  for (auto it = m_pendingEvents.rbegin(); it != m_pendingEvents.rend();
+       ++it) {
+    xcb_generic_event_t *xcbEvent = *it;
+    bool bDrop = false;
+
+    switch (xcbEvent->response_type & ~0x80) {
+    case XCB_MOTION_NOTIFY:
+      bDrop = !kept.empty() &&
+              (kept.front()->response_type & ~0x80) == XCB_MOTION_NOTIFY;
+      break;
+    case XCB_BUTTON_RELEASE: {
+      xcb_button_release_event_t *br = (xcb_button_release_event_t *)xcbEvent;
+      bDrop = br->detail == XCB_BUTTON_INDEX_4 ||
+              br->detail == XCB_BUTTON_INDEX_5;
+    } break;
+    case XCB_CONFIGURE_NOTIFY:
+      bDrop = bConfigure;
+      bConfigure = true;
+      break;
+    }
+
+    if (bDrop)
+      free(xcbEvent);
+    else
+      kept.push_front(xcbEvent);
   }
-  return faceID;
+
+  m_pendingEvents.swap(kept);
+  m_bCoalesced = true;
 }
-#endif // defined
 
 /**
 \internal
-\brief The function returns the width of the string according to the font
-size.
+\brief returns the next event for the message loop. Events kept while
+waiting for a buffer are returned first, they are coalesced along with the
+events queued behind them. Otherwise the loop waits for an event, and the
+events received along with it are queued and coalesced as one batch. When a
+frame has been requested, the wait ends when the frame is due and nullptr
+is returned. nullptr is also returned when the connection fails.
 */
-int uxdevice::platform::measureTextWidth(const std::string &sTextFace,
-                                         const int pointSize,
-                                         const std::string &s) {
-
-#if defined(USE_FREETYPE)
-  bool bProcessedOnce = false;
-  FT_Error error;
-  FTC_ScalerRec scaler;
-  FT_Size sizeFace;
-  FT_UInt glyph_index = 0;
-  FT_UInt previous_index = 0;
-  int returnedWidth = 0;
+xcb_generic_event_t *uxdevice::platform::nextEvent(void) {
+  if (!m_bCoalesced && !m_pendingEvents.empty()) {
+    xcb_generic_event_t *xcbEvent;
+    while ((xcbEvent = xcb_poll_for_queued_event(m_connection)))
+      m_pendingEvents.push_back(xcbEvent);
+    coalesceEvents();
+  }
 
-  // store a cache record for loaded fonts.
-  FTC_FaceID faceID = getFaceID(sTextFace);
+  while (m_pendingEvents.empty()) {
+    xcb_generic_event_t *xcbEvent = xcb_poll_for_event(m_connection);
+    if (xcbEvent) {
+      do
+        m_pendingEvents.push_back(xcbEvent);
+      while ((xcbEvent = xcb_poll_for_queued_event(m_connection)));
+      coalesceEvents();
+      break;
+    }
 
-  // having this as a local variable
-  scaler.face_id = faceID;
-  scaler.pixel = 0;
-  scaler.height = (pointSize + fontScale) * 64;
-  scaler.width = (pointSize + fontScale) * 64;
+    if (xcb_connection_has_error(m_connection))
+      return nullptr;
+
+    int timeout = m_bFrameRequested ? frameTimeout() : -1;
+    if (timeout == 0)
+      return nullptr;
+
+    // a display list published by another thread ends the wait.
+    pollfd descriptors[] = {
+        {xcb_get_file_descriptor(m_connection), POLLIN, 0},
+        {m_wakeFd, POLLIN, 0}};
+    if (poll(descriptors, m_wakeFd >= 0 ? 2 : 1, timeout) == 0)
+      return nullptr;
+    if (descriptors[1].revents & POLLIN) {
+      uint64_t count;
+      if (read(m_wakeFd, &count, sizeof(count)) > 0)
+        return nullptr;
+    }
+  }
 
-  scaler.x_res = 96;
-  scaler.y_res = 96;
+  xcb_generic_event_t *xcbEvent = m_pendingEvents.front();
+  m_pendingEvents.pop_front();
+  return xcbEvent;
+}
 
-  // get the face
-  error = FTC_Manager_LookupSize(m_cacheManager, &scaler, &sizeFace);
+/**
+\internal
+\brief returns the milliseconds until a requested frame is due. With the
+present extension, the frame is due when the notify msc request completes.
+The frame is also produced if the completion does not arrive within a few
+frame intervals, for instance while the window is not on a crtc. Otherwise
+frames are produced FRAME_RATE times per second.
+*/
+int uxdevice::platform::frameTimeout(void) {
+  using namespace std::chrono;
+  const microseconds interval(1000000 / FRAME_RATE);
+  steady_clock::time_point due;
 
-  if (error)
-    throw std::runtime_error("Could not retrieve font face.");
+  if (m_bPresentPacing && !m_bMscPending)
+    return 0;
+  else if (m_bPresentPacing)
+    due = m_mscTime + interval * 4;
+  else
+    due = m_frameTime + interval;
 
-  error = FT_Activate_Size(sizeFace);
-  if (error)
-    throw std::runtime_error("Could FT_Activate_Size for font.");
+  auto remaining = duration_cast<milliseconds>(due - steady_clock::now());
+  return std::max(static_cast<int>(remaining.count()), 0);
+}
 
-  FT_Face face = sizeFace->face;
+/**
+\internal
+\brief handles a present complete notify event. Returns false if the
+event is not one.
+*/
+bool uxdevice::platform::frameNotify(xcb_generic_event_t *xcbEvent) {
+  if (!m_bPresentPacing || (xcbEvent->response_type & ~0x80) != XCB_GE_GENERIC)
+    return false;
+
+  xcb_ge_generic_event_t *generic =
+      reinterpret_cast<xcb_ge_generic_event_t *>(xcbEvent);
+  if (generic->extension != m_presentOpcode ||
+      generic->event_type != XCB_PRESENT_COMPLETE_NOTIFY)
+    return false;
+
+  xcb_present_complete_notify_event_t *complete =
+      reinterpret_cast<xcb_present_complete_notify_event_t *>(xcbEvent);
+  if (complete->kind == XCB_PRESENT_COMPLETE_KIND_NOTIFY_MSC &&
+      complete->serial == m_presentSerial)
+    m_bMscPending = false;
 
-  // iterate characters in string
-  for (auto &c : s) {
+  return true;
+}
 
-    // handle special characters
-    if (c == '\t') {
-      returnedWidth += 50;
-      continue;
+/**
+\internal
+\brief produces the requested frame.
+*/
+void uxdevice::platform::presentFrame(void) {
+  m_bFrameRequested = false;
+  m_bMscPending = false;
+  m_frameTime = std::chrono::steady_clock::now();
+
+#if defined(USE_RENDER_THREAD)
+  // a snapshot not yet taken by the render thread is replaced.
+  std::shared_ptr<const displayList> list = published();
+  const std::uint64_t generation = list->generation();
+  {
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    // a scroll is kept only when it is the only change since the last
+    // snapshot.
+    if (scrollOnly(*list) && !m_bFramePosted)
+      m_frameScroll = m_scrolls.front();
+    else
+      m_frameScroll.reset();
+    m_frameList.swap(list);
+    m_frameScale = fontScale;
+    m_bFrameFull = m_bFrameFull || m_bSceneChanged;
+    m_bFramePosted = true;
+  }
+  m_frameReady.notify_one();
+  m_scrolls.clear();
+  m_drawnGeneration = generation;
+  m_bSceneChanged = false;
+#else
+  dispatchEvent(event{eventType::paint});
+#endif
+}
+
+/**
+\internal
+\brief the render thread draws the posted snapshots. The back buffer is
+acquired before m_renderMutex is taken so that the event thread may resize
+while the server reads the buffer.
+*/
+void uxdevice::platform::renderLoop(void) {
+  std::shared_ptr<const displayList> list;
+  std::shared_ptr<const displayList> drawn;
+  int scale;
+  int drawnScale = 0;
+  bool bFull;
+  std::optional<scrollMove> move;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_frameMutex);
+      m_frameReady.wait(lock,
+                        [this] { return m_bFramePosted || m_bRenderExit; });
+      if (m_bRenderExit)
+        return;
+      list.swap(m_frameList);
+      scale = m_frameScale;
+      move = m_frameScroll;
+      bFull = m_bFrameFull;
+      m_bFrameFull = false;
+      m_bFramePosted = false;
     }
 
-    // get the index of the glyph
-    glyph_index = FTC_CMapCache_Lookup(m_cmapCache, faceID, 0, c);
+    acquireBuffer();
 
-    // the kerning of a font depends on the previous character
-    // some proportional fonts provide tighter spacing which improves
-    // rendering characteristics
-    if (bProcessedOnce && FT_HAS_KERNING(face)) {
-      FT_Vector akerning;
-      error = FT_Get_Kerning(face, previous_index, glyph_index,
-                             FT_KERNING_DEFAULT, &akerning);
-      if (!error) {
-        returnedWidth += akerning.x >> 6;
-      }
+    std::lock_guard<std::mutex> lock(m_renderMutex);
+    if (m_bRenderExit)
+      return;
+    m_surface.pixels = m_buffers[m_backBuffer].info.shmaddr;
+    bool bDrawn = move && scrollFrame(*list, scale, *move);
+    std::optional<std::vector<rectangle>> damage;
+    if (!bDrawn && !bFull && drawn && drawnScale == scale) {
+      damage = displayDiff(*drawn, *list).damage();
+      bDrawn = damageFrame(*list, scale, *damage);
     }
+    if (!bDrawn) {
+      clear();
+      render(*list, scale);
+      flip(damage);
+    }
+    drawn = list;
+    drawnScale = scale;
+  }
+}
 
-    int xadvance;
-
-#ifdef USE_FREETYPE_GREYSCALE_ANTIALIAS
-    // get the image
-    FTC_SBit bitmap;
-    error = FTC_SBitCache_LookupScaler(m_bitCache, &scaler, FT_LOAD_RENDER,
-                                       glyph_index, &bitmap, nullptr);
+/**
+\internal
+\brief waits for the server to finish reading the shared memory buffers
+and releases them.
+*/
+void uxdevice::platform::releaseBuffers(void) {
+  for (size_t i = 0; i < m_buffers.size(); i++) {
+    {
+      std::lock_guard<std::mutex> lock(m_bufferMutex);
+      m_backBuffer = i;
+    }
+    acquireBuffer();
+  }
 
-    if (error)
+  std::lock_guard<std::mutex> lock(m_bufferMutex);
+  for (auto &buffer : m_buffers) {
+    if (!m_bSharedMemory)
       continue;
+    xcb_shm_detach(m_connection, buffer.info.shmseg);
+    shmdt(buffer.info.shmaddr);
+  }
+  m_buffers.clear();
+  m_bufferCapacity = 0;
+  m_backBuffer = 0;
+}
+#endif
 
-    xadvance = bitmap->xadvance;
-
-#elif defined USE_FREETYPE_LCD_FILTER
-    FT_Glyph aglyph;
-    FT_BitmapGlyph bitmap;
-
-    // get the image, however this is just the outline
-    error = FTC_ImageCache_LookupScaler(m_imageCache, &scaler, FT_LOAD_DEFAULT,
-                                        glyph_index, &aglyph, nullptr);
-    if (error)
-      continue;
+uxdevice::imageData::imageData(std::shared_ptr<int> _width,
+                               std::shared_ptr<int> _height,
+                               std::shared_ptr<std::vector<u_int8_t>> _data) {
 
-    xadvance = (aglyph->advance.x + 0x8000) >> 16;
+  cache = make_shared<imageCache>();
 
-#endif
+#ifdef USE_STB_IMAGE
+  width = _width;
+  height = _height;
+  data = _data;
 
-    // move after render
-    returnedWidth += xadvance;
-    bProcessedOnce = true;
-    previous_index = glyph_index;
-  }
-  return returnedWidth;
-#endif // defined
-
+  imageBuffer source;
+  source.width = *width;
+  source.height = *height;
+  source.stride = *width * 4;
+  source.pixels = data->data();
+  source.storage = data;
+  cache->source(source);
+#endif // USE_STB_IMAGE
 }
 
-/**
-\internal
-\brief the function measures the height of the textFace
-\param const std::string &sTextFace the face name
-\param const int pointSize the size in point of the font
+uxdevice::imageData::imageData(std::shared_ptr<std::string> _fileName) {
+  fileName = _fileName;
 
-*/
-int uxdevice::platform::measureFaceHeight(const std::string &sTextFace,
-                                          const int pointSize) {
-#if defined(USE_FREETYPE)
-  FT_Error error;
-  FTC_ScalerRec scaler;
-  FT_Size sizeFace;
+  // the native raw format is mapped and used without decoding.
+  if (mapRaw(*_fileName))
+    return;
 
-  // store a cache record for loaded fonts.
-  FTC_FaceID faceID = getFaceID(sTextFace);
+#if defined(USE_STB_IMAGE)
+  int w, h, n;
+  NSVGimage *shapes = NULL;
+  unsigned char *localData = NULL;
 
-  // having this as a local variable
-  scaler.face_id = faceID;
-  scaler.pixel = 0;
-  scaler.height = (pointSize + fontScale) * 64;
-  scaler.width = (pointSize + fontScale) * 64;
+  if ((localData = stbi_load(_fileName->data(), &w, &h, &n, 4)))
+    ;
+  else if ((shapes = nsvgParseFromFile(_fileName->data(), "px", 96.0f))) {
+    // the document is kept and rasterized at the size it is drawn.
+    width = make_shared<int>(static_cast<int>(shapes->width));
+    height = make_shared<int>(static_cast<int>(shapes->height));
+    cache = make_shared<imageCache>();
+    cache->vectorSource(shared_ptr<NSVGimage>(shapes, nsvgDelete));
+    return;
+  } else {
+    string info = "Cannot load the file: ";
+    info += *_fileName;
+    throw std::invalid_argument(info);
+  }
+  /* the decoded pixels are converted in place and owned by the cache. Every
+  source is premultiplied, as are the raw pixel files. */
+  pixelConvert::swizzle(localData, pixelFormat::rgba, localData,
+                        pixelFormat::bgra, static_cast<size_t>(w) * h);
+  pixelConvert::premultiply(localData, localData, static_cast<size_t>(w) * h);
+  width = make_shared<int>(w);
+  height = make_shared<int>(h);
 
-  scaler.x_res = 96;
-  scaler.y_res = 96;
+  imageBuffer source;
+  source.width = w;
+  source.height = h;
+  source.stride = w * 4;
+  source.pixels = localData;
+  source.storage = shared_ptr<void>(localData, stbi_image_free);
+  cache = make_shared<imageCache>();
+  cache->source(source, true);
 
-  // get the face
-  error = FTC_Manager_LookupSize(m_cacheManager, &scaler, &sizeFace);
+#elif defined(USE_IMAGE_MAGICK)
+  data = make_shared<Magick::Image>();
+  data->type(Magick::TrueColorType);
+  data->backgroundColor("None");
 
-  if (error)
-    throw std::runtime_error("Could not retrieve font face.");
+  /* very large images are still decoded whole when they are loaded, this
+  is not a region of interest decode. The area resource limit is lowered for
+  the read so that the decoded pixels go to a disk backed pixel cache rather
+  than to memory. Tiles are then exported from that cache region by region
+  as they become visible. The limit is global to the process, it is
+  restored when the read and conversion end, also when they throw. */
+  Magick::Image info;
+  info.ping(*_fileName);
+  bool bTiled = info.columns() * info.rows() > TILED_IMAGE_PIXELS;
+
+  using areaLimitGuard = class areaLimitGuard {
+  public:
+    MagickCore::MagickSizeType limit;
+    areaLimitGuard(const bool bLower)
+        : limit(MagickCore::GetMagickResourceLimit(MagickCore::AreaResource)) {
+      if (bLower)
+        MagickCore::SetMagickResourceLimit(MagickCore::AreaResource,
+                                           TILED_IMAGE_PIXELS);
+    }
+    ~areaLimitGuard() {
+      MagickCore::SetMagickResourceLimit(MagickCore::AreaResource, limit);
+    }
+  };
 
-  error = FT_Activate_Size(sizeFace);
-  if (error)
-    throw std::runtime_error("Could FT_Activate_Size for font.");
+  {
+    areaLimitGuard guard(bTiled);
+    data->read(*_fileName);
 
-  FT_Face face = sizeFace->face;
+    // the pixel conversions expect red, green, blue and alpha quanta.
+    if (data->colorSpace() != Magick::sRGBColorspace)
+      data->colorSpace(Magick::sRGBColorspace);
+  }
 
-  // get the height of the font
-  int faceHeight = face->size->metrics.height >> 6;
-  return static_cast<int>(faceHeight);
-#endif // defined
+  if (bTiled) {
+    shared_ptr<Magick::Image> image = data;
+    tiles = make_shared<tiledImage>(
+        data->columns(), data->rows(),
+        [image](const int x, const int y, imageBuffer &tile) {
+          exportRegion(*image, x, y, tile);
+        });
+    cache = make_shared<imageCache>();
+    return;
+  }
 
-}
+  Magick::Color bg_color = data->pixelColor(0,0);
+  data->transparent(bg_color);
+  //data-> matte(true);
 
-/**
-  \internal
-  \brief the function draws the cursor.
-  */
-void uxdevice::platform::drawCaret(const int x, const int y, const int h) {
-  for (int j = y; j < y + h; j++)
-    putPixel(x, j, 0x00);
+  // the cache owns the pixels, the Magick image is released.
+  cache = make_shared<imageCache>();
+  cache->source(exportPixels(*data), true);
+  data.reset();
+#endif // USE_IMAGE_MAGICK
 }
-
+
 /**
 \internal
-\brief the function clears the dirty rectangles of the off screen buffer.
+\brief The raw pixel file holds premultiplied bgra pixels which are used
+directly from a memory mapping, no decoding or copying occurs. The file
+begins with the rawImageHeader, followed by one rawImageLevel per stored mip
+level. Level zero is the full size image. Every level starts on a page
+boundary and each row is padded to a multiple of 64 bytes. Values are stored
+in the native byte order of the machine which wrote the file.
 */
-void uxdevice::platform::clear(void) {
-#if defined(USE_DIRECT_SCREEN_OUTPUT) && !defined(USE_IMAGE_MAGICK)
-  fill(m_offscreenBuffer.begin(), m_offscreenBuffer.end(), 0xFF);
-
-#elif defined(USE_IMAGE_MAGICK)
-  m_offscreenImage.strokeColor("white"); // Outline color
-  m_offscreenImage.fillColor("white"); // Fill color
-  m_offscreenImage.strokeWidth(0);
-  m_offscreenImage.draw( Magick::DrawableRectangle(0,0, m_offscreenImage.columns(),m_offscreenImage.rows()));
-#endif // defined
-
-  m_xpos = 0;
-  m_ypos = 0;
-}
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levels;
+  uint32_t flags;
+} rawImageHeader;
+
+typedef struct {
+  uint64_t offset;
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  uint32_t reserved;
+} rawImageLevel;
+
+static const char rawImageMagic[4] = {'U', 'X', 'R', 'P'};
+static const uint32_t rawImageVersion = 1;
+static const uint32_t rawImagePremultiplied = 1;
+static const uint32_t rawImageMaxLevels = 32;
 
 /**
-\brief The function places a color into the offscreen pixel buffer.
-    Coordinate start at 0,0, upper left.
-\param x - the left point of the pixel
-\param y - the top point of the pixel
-\param unsigned int color - the bgra color value
-
+\internal
+\brief The function maps an open raw pixel file, filling levels with
+buffers that reference the mapping. The mapping is read only and shared, it
+is released when the last imageBuffer referencing it is gone. False is
+returned if the file is not a raw pixel file. A raw file which fails
+validation throws.
 */
-#if defined(USE_DIRECT_SCREEN_OUTPUT) && !defined(USE_IMAGE_MAGICK)
-void uxdevice::platform::putPixel(const int x, const int y,
-                                  const unsigned int color) {
-  if (x < 0 || y < 0)
-    return;
+#if defined(__linux__)
+static bool mapRawLevels(const int fd, const std::string &sName,
+                         vector<imageBuffer> &levels) {
+  rawImageHeader header;
+  struct stat fileInfo;
+  if (fstat(fd, &fileInfo) != 0 ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, rawImageMagic, sizeof(rawImageMagic)) != 0)
+    return false;
+
+  size_t length = fileInfo.st_size;
+  void *address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+
+  string info = "Invalid raw pixel file: ";
+  info += sName;
+  if (address == MAP_FAILED)
+    throw std::invalid_argument(info);
 
-  // clip coordinates
-  if (x >= _w || y >= _h)
-    return;
+  shared_ptr<void> mapping(address,
+                           [length](void *p) { munmap(p, length); });
 
-  // calculate offset
-  unsigned int offset = x * 4 + y * 4 * _w;
+  // validate the header and level table against the file size.
+  if (header.version != rawImageVersion ||
+      !(header.flags & rawImagePremultiplied) || header.levels == 0 ||
+      header.levels > rawImageMaxLevels ||
+      sizeof(header) + header.levels * sizeof(rawImageLevel) > length)
+    throw std::invalid_argument(info);
 
-  // put rgba color
-  unsigned int *p =
-      reinterpret_cast<unsigned int *>(&m_offscreenBuffer[offset]);
-  *p = color;
-}
+  const rawImageLevel *table = reinterpret_cast<const rawImageLevel *>(
+      static_cast<u_int8_t *>(address) + sizeof(header));
+  levels.clear();
+  for (uint32_t i = 0; i < header.levels; i++) {
+    const rawImageLevel &level = table[i];
+    // the sizes must fit the int fields of imageBuffer, the row size is
+    // computed in 64 bits so that a large width cannot wrap.
+    if (level.width == 0 || level.height == 0 ||
+        level.width > INT_MAX / 4 || level.height > INT_MAX ||
+        level.stride > INT_MAX ||
+        static_cast<uint64_t>(level.stride) <
+            static_cast<uint64_t>(level.width) * 4 ||
+        level.offset > length ||
+        static_cast<uint64_t>(level.stride) * level.height >
+            length - level.offset)
+      throw std::invalid_argument(info);
+
+    imageBuffer buffer;
+    buffer.width = level.width;
+    buffer.height = level.height;
+    buffer.stride = level.stride;
+    buffer.pixels = static_cast<u_int8_t *>(address) + level.offset;
+    buffer.storage = mapping;
+    levels.push_back(buffer);
+  }
 
-#elif defined(USE_IMAGE_MAGICK)
-void uxdevice::platform::putPixel(const int x, const int y,
-                                  const Magick::Color color) {
-
-  if (x < 0 || y < 0)
-    return;
-
-  // clip coordinates
-  if (x >= _w || y >= _h)
-    return;
-
-  Magick::Quantum *p = &m_offscreenBuffer[x*4+y*_w*4];
-  *p=color.quantumRed();
-  p++;
-  *p=color.quantumGreen();
-  p++;
-  *p=color.quantumBlue();
-  p++;
-
-}
-#endif // defined
-
+  if (levels.front().width != static_cast<int>(header.width) ||
+      levels.front().height != static_cast<int>(header.height))
+    throw std::invalid_argument(info);
 
-/**
-\brief The function returns the color at the pixel space. Coordinate start
-at 0,0, upper left. \param x - the left point of the pixel \param y - the
-top point of the pixel \param unsigned int color - the bgra color value
+  return true;
+}
+#endif // __linux__
 
+/**
+\internal
+\brief The function writes the levels in the raw pixel format. The pixels
+are premultiplied already, as every source is. Returns false if writing
+failed.
 */
-#if defined(USE_DIRECT_SCREEN_OUTPUT) && !defined(USE_IMAGE_MAGICK)
-unsigned int uxdevice::platform::getPixel(const int x, const int y) {
-  // clip coordinates
-  if (x < 0 || y < 0)
-    return 0;
+static bool writeRawLevels(std::ostream &file,
+                           const vector<imageBuffer> &levels) {
+  // compute the layout, levels are page aligned and rows 64 byte aligned.
+  const uint64_t pageSize = 4096;
+  rawImageHeader header;
+  memcpy(header.magic, rawImageMagic, sizeof(rawImageMagic));
+  header.version = rawImageVersion;
+  header.width = levels.front().width;
+  header.height = levels.front().height;
+  header.levels = levels.size();
+  header.flags = rawImagePremultiplied;
+
+  vector<rawImageLevel> table(levels.size());
+  uint64_t offset = sizeof(header) + table.size() * sizeof(rawImageLevel);
+  for (size_t i = 0; i < levels.size(); i++) {
+    offset = (offset + pageSize - 1) & ~(pageSize - 1);
+    table[i].offset = offset;
+    table[i].width = levels[i].width;
+    table[i].height = levels[i].height;
+    table[i].stride = (levels[i].width * 4 + 63) & ~63;
+    table[i].reserved = 0;
+    offset += static_cast<uint64_t>(table[i].stride) * table[i].height;
+  }
 
-  if (x >= _w || y >= _h)
-    return 0;
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(table.data()),
+             table.size() * sizeof(rawImageLevel));
 
-  // calculate offset
-  unsigned int offset = x * 4 + y * 4 * _w;
+  vector<u_int8_t> row;
+  for (size_t i = 0; i < levels.size(); i++) {
+    const imageBuffer &level = levels[i];
+    row.assign(table[i].stride, 0);
 
-  // put rgba color
-  unsigned int *p =
-      reinterpret_cast<unsigned int *>(&m_offscreenBuffer[offset]);
-  return *p;
+    // pad up to the start of the level
+    uint64_t position = file.tellp();
+    vector<char> padding(table[i].offset - position, 0);
+    file.write(padding.data(), padding.size());
 
-}
+    for (int y = 0; y < level.height; y++) {
+      memcpy(row.data(), level.pixels + y * level.stride, level.width * 4);
+      file.write(reinterpret_cast<const char *>(row.data()), row.size());
+    }
+  }
 
-#elif defined(USE_IMAGE_MAGICK)
-Magick::Color uxdevice::platform::getPixel(const int x, const int y) {
-  if (x < 0 || y < 0)
-    return Magick::Color("black");
-
-  // clip coordinates
-  if (x >= _w || y >= _h)
-    return Magick::Color("black");
-
-  Magick::Quantum *p = &m_offscreenBuffer[x*4+y*m_offscreenImage.columns()*4];
-  return Magick::Color(*p,*(p+1),*(p+2));
-}
-#endif // defined
+  return static_cast<bool>(file);
+}
 
 /**
-\brief The function provides the reallocation of the offscreen buffer
-
+\internal
+\brief The function maps the file when it is in the raw pixel format. False
+is returned if the file is not a raw pixel file so that the caller may
+decode it.
 */
-void uxdevice::platform::resize(const int w, const int h) {
-
-  _w = w;
-  _h = h;
-
+bool uxdevice::imageData::mapRaw(const std::string &sFileName) {
 #if defined(__linux__)
-
-  // free old one if it exists
-  if (m_pix) {
-    xcb_shm_detach(m_connection, m_info.shmseg);
-    shmdt(m_info.shmaddr);
-    xcb_free_pixmap(m_connection, m_pix);
+  int fd = open(sFileName.data(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  vector<imageBuffer> levels;
+  bool bMapped = false;
+  try {
+    bMapped = mapRawLevels(fd, sFileName, levels);
+  } catch (...) {
+    close(fd);
+    throw;
   }
+  close(fd);
 
-  // Shared memory test.
-  // https://stackoverflow.com/questions/27745131/how-to-use-shm-pixmap-with-xcb?noredirect=1&lq=1
-  xcb_shm_query_version_reply_t *reply;
+  if (!bMapped)
+    return false;
 
-  reply = xcb_shm_query_version_reply(
-      m_connection, xcb_shm_query_version(m_connection), NULL);
-
-  if (!reply || !reply->shared_pixmaps) {
-    cout << "Could not get a shared memory image." << endl;
-    exit(0);
-  }
-
-  size_t _bufferSize = _w * _h * 4;
+#if defined(USE_STB_IMAGE)
+  width = make_shared<int>(levels.front().width);
+  height = make_shared<int>(levels.front().height);
+#endif // USE_STB_IMAGE
 
-  m_info.shmid = shmget(IPC_PRIVATE, _bufferSize, IPC_CREAT | 0600);
-  m_info.shmaddr = (uint8_t *)shmat(m_info.shmid, 0, 0);
+  cache = make_shared<imageCache>();
+  cache->levels(levels);
+  return true;
 
-  m_info.shmseg = xcb_generate_id(m_connection);
-  xcb_shm_attach(m_connection, m_info.shmseg, m_info.shmid, 0);
-  shmctl(m_info.shmid, IPC_RMID, 0);
+#else
+  return false;
+#endif
+}
 
-  m_screenMemoryBuffer = static_cast<uint8_t *>(m_info.shmaddr);
+/**
+\internal
+\brief The function writes the image in the raw pixel format. The source
+pixels are premultiplied, they are written as they are. When bMipLevels is
+set, the mip chain is stored as well, down to a size of one pixel. An svg
+has no pixels, it is rasterized at its document size multiplied by dScale,
+which should be the device scale of the screen the file is drawn on.
+*/
+void uxdevice::imageData::writeRaw(const std::string &sFileName,
+                                   const bool bMipLevels,
+                                   const double dScale) {
+#if defined(USE_STB_IMAGE)
+  imageBuffer source;
+  if (cache->isVector()) {
+    if (!(dScale > 0.0)) {
+      string info = "Invalid scale for the file: ";
+      info += sFileName;
+      throw std::invalid_argument(info);
+    }
+    source = cache->rasterize(
+        std::max(static_cast<int>(std::lround(cache->width() * dScale)), 1),
+        std::max(static_cast<int>(std::lround(cache->height() * dScale)), 1));
+  } else {
+    source = cache->source();
+  }
 
-  m_pix = xcb_generate_id(m_connection);
-  xcb_shm_create_pixmap(m_connection, m_pix, m_window, _w, _h,
-                        m_screen->root_depth, m_info.shmseg, 0);
-
-  m_offscreenBuffer.resize(_bufferSize);
+#elif defined(USE_IMAGE_MAGICK)
+  imageBuffer source = tiles ? exportPixels(*data) : cache->source();
+#endif
 
-  // clear to white
-  clear();
+  // build the levels
+  vector<imageBuffer> levels = {source};
+  while (bMipLevels && (levels.back().width > 1 || levels.back().height > 1)) {
+    const imageBuffer &current = levels.back();
+    imageBuffer next(std::max(current.width / 2, 1),
+                     std::max(current.height / 2, 1));
+    boxDownsample(current, next);
+    levels.push_back(next);
+  }
 
-#elif defined(_WIN64)
-  // get the size ofthe window
-  RECT rc;
-  GetClientRect(m_hwnd, &rc);
+  ofstream file(sFileName, ios::binary | ios::trunc);
+  if (!file || !writeRawLevels(file, levels)) {
+    string info = "Cannot write the file: ";
+    info += sFileName;
+    throw std::invalid_argument(info);
+  }
+}
 
-  // resize the pixel memory
-  _w = rc.right - rc.left;
-  _h = rc.bottom - rc.top;
+/**
+\internal
+\brief closes the spill file of an evicted image.
+*/
+uxdevice::imageCache::~imageCache() {
+#if defined(__linux__)
+  if (m_spillFile >= 0)
+    close(m_spillFile);
+#endif
+}
 
-  int _bufferSize = _w * _h * 4;
-
-  m_offscreenBuffer.resize(_bufferSize);
+/**
+\internal
+\brief returns the number of bytes of pixels held in memory by the cache.
+Mapped levels are not counted since they are backed by a file and are paged
+in and out by the system.
+*/
+std::size_t uxdevice::imageCache::residentBytes(void) {
+  size_t bytes = 0;
+  if (m_bOwned && !m_bEvicted)
+    bytes += static_cast<size_t>(m_source.stride) * m_source.height;
 
-  // clear to white
-  clear();
+  for (size_t i = std::max<size_t>(m_seededLevels, 1); i < m_mips.size(); i++)
+    bytes += static_cast<size_t>(m_mips[i].stride) * m_mips[i].height;
 
-  // free existing resources
-  if (m_pRenderTarget) {
-    m_pRenderTarget->Resize(D2D1::SizeU(_w, _h));
+  for (auto &entry : m_entries)
+    bytes += static_cast<size_t>(entry.stride) * entry.height;
 
-  } else {
+  return bytes;
+}
 
-    // Create a Direct2D render target
-    HRESULT hr = m_pD2DFactory->CreateHwndRenderTarget(
-        D2D1::RenderTargetProperties(),
-        D2D1::HwndRenderTargetProperties(m_hwnd, D2D1::SizeU(_w, _h)),
-        &m_pRenderTarget);
-    if (FAILED(hr))
-      return;
+#if defined(__linux__)
+/**
+\internal
+\brief returns the directory evicted images are written to, see
+IMAGE_SPILL_DIRECTORY. A cache directory is created when it is missing.
+*/
+static std::string spillDirectory(void) {
+#if defined(IMAGE_SPILL_DIRECTORY)
+  return IMAGE_SPILL_DIRECTORY;
+#else
+  if (const char *dir = getenv("UXDEVICE_SPILL_DIR"))
+    return dir;
+
+  string sCache;
+  if (const char *dir = getenv("XDG_CACHE_HOME"))
+    sCache = dir;
+  else if (const char *home = getenv("HOME"))
+    sCache = string(home) + "/.cache";
+
+  if (!sCache.empty()) {
+    mkdir(sCache.data(), 0700);
+    sCache += "/uxdevice";
+    if (mkdir(sCache.data(), 0700) == 0 || errno == EEXIST)
+      return sCache;
   }
+  return "/var/tmp";
 #endif
 }
+#endif // __linux__
 
 /**
-\brief The function copies the pixel buffer to the screen
-
+\internal
+\brief writes the owned source pixels to an unlinked file in the spill
+directory. The descriptor is kept so the pixels can be mapped again. The
+file is only written once, later evictions reuse it.
 */
-void uxdevice::platform::flip() {
-#if defined(__linux__)
-
-  // copy offscreen data to the shared memory video buffer
-  memcpy(m_screenMemoryBuffer, m_offscreenBuffer.data(),
-         m_offscreenBuffer.size());
-
-  // blit the shared memory buffer
-  xcb_copy_area(m_connection, m_pix, m_window, m_graphics, 0, 0, 0, 0, _w, _h);
+bool uxdevice::imageCache::spill(void) {
+#if defined(__linux__)
+  if (m_spillFile >= 0)
+    return true;
 
-  xcb_flush(m_connection);
+  string sPath = spillDirectory();
+  sPath += "/uxdeviceXXXXXX";
 
-#elif defined(_WIN64)
-  if (!m_pRenderTarget)
-    return;
+  int fd = mkstemp(sPath.data());
+  if (fd < 0)
+    return false;
 
-  m_pRenderTarget->BeginDraw();
+  ofstream file(sPath, ios::binary | ios::trunc);
+  bool bWritten = file && writeRawLevels(file, {m_source});
+  file.close();
+  unlink(sPath.data());
 
-  // create offscreen bitmap for pixel rendering
-  D2D1_PIXEL_FORMAT desc2D = D2D1::PixelFormat();
-  desc2D.format = DXGI_FORMAT_B8G8R8A8_UNORM;
-  desc2D.alphaMode = D2D1_ALPHA_MODE_IGNORE;
+  if (!bWritten) {
+    close(fd);
+    return false;
+  }
 
-  D2D1_BITMAP_PROPERTIES bmpProperties = D2D1::BitmapProperties();
-  m_pRenderTarget->GetDpi(&bmpProperties.dpiX, &bmpProperties.dpiY);
-  bmpProperties.pixelFormat = desc2D;
+  m_spillFile = fd;
+  return true;
 
-  RECT rc;
-  GetClientRect(m_hwnd, &rc);
+#else
+  return false;
+#endif
+}
 
-  D2D1_SIZE_U size = D2D1::SizeU(_w, _h);
-  HRESULT hr = m_pRenderTarget->CreateBitmap(
-      size, m_offscreenBuffer.data(), _w * 4, &bmpProperties, &m_pBitmap);
+/**
+\internal
+\brief releases the scaled variants and, when they are owned, the source
+pixels. Levels mapped from a raw pixel file are kept. Returns the number of
+bytes reclaimed.
+*/
+std::size_t uxdevice::imageCache::evict(void) {
+  size_t bytes = residentBytes();
+
+  if (m_bOwned && !m_bEvicted) {
+    if (spill()) {
+      m_source = imageBuffer();
+      m_bEvicted = true;
+    } else {
+      bytes -= static_cast<size_t>(m_source.stride) * m_source.height;
+    }
+  }
 
-  // render bitmap to screen
-  D2D1_RECT_F rectf;
-  rectf.left = 0;
-  rectf.top = 0;
-  rectf.bottom = _h;
-  rectf.right = _w;
+  m_mips.resize(m_bEvicted ? 0 : std::min(m_mips.size(), m_seededLevels));
+  m_entries.clear();
+  m_lastWidth = 0;
+  m_lastHeight = 0;
 
-  m_pRenderTarget->DrawBitmap(m_pBitmap, rectf, 1.0f,
-                              D2D1_BITMAP_INTERPOLATION_MODE_NEAREST_NEIGHBOR);
+  return bytes;
+}
 
-  m_pRenderTarget->EndDraw();
-  m_pBitmap->Release();
+/**
+\internal
+\brief maps the spilled pixels of an evicted image. No decoding occurs, the
+pages are read as they are drawn.
+*/
+void uxdevice::imageCache::restore(void) {
+#if defined(__linux__)
+  if (!m_bEvicted)
+    return;
 
+  vector<imageBuffer> spilled;
+  mapRawLevels(m_spillFile, "spill file", spilled);
+  levels(spilled);
 #endif
 }
 
-uxdevice::imageData::imageData(std::shared_ptr<int> _width,
-                               std::shared_ptr<int> _height,
-                               std::shared_ptr<std::vector<u_int8_t>> _data) {
+/**
+\internal
+\brief adds the image to the images governed by the memory budget.
+*/
+void uxdevice::platform::trackImage(const std::shared_ptr<imageCache> &cache) {
+  if (cache->bTracked)
+    return;
 
-#ifdef USE_STB_IMAGE
-  width = _width;
-  height = _height;
-  data = _data;
-#endif // USE_STB_IMAGE
+  cache->bTracked = true;
+  m_images.push_back(cache);
+
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
+  // a finished background raster is drawn by an expose sent to the window.
+  xcb_connection_t *connection = m_connection;
+  xcb_window_t window = m_window;
+  cache->notify([connection, window]() {
+    char buffer[32] = {};
+    xcb_expose_event_t *expose = reinterpret_cast<xcb_expose_event_t *>(buffer);
+    expose->response_type = XCB_EXPOSE;
+    expose->window = window;
+    xcb_send_event(connection, false, window, XCB_EVENT_MASK_EXPOSURE, buffer);
+    xcb_flush(connection);
+  });
+#endif
 }
 
-uxdevice::imageData::imageData(std::shared_ptr<std::string> _fileName) {
-  fileName = _fileName;
+/**
+\internal
+\brief sets the image memory policy. Images not drawn within idleWindow are
+evicted, least recently drawn first, while the resident bytes of all images
+exceed budgetBytes. A budget of zero evicts every idle image.
+*/
+void uxdevice::platform::imageMemory(
+    const std::chrono::milliseconds &idleWindow,
+    const std::size_t budgetBytes) {
+  std::lock_guard<std::mutex> lock(m_imageMemoryMutex);
+  m_imageIdleWindow = idleWindow;
+  m_imageMemory.budgetBytes = budgetBytes;
+}
 
-#if defined(USE_STB_IMAGE)
-  int w, h, n;
-  NSVGimage *shapes = NULL;
-  NSVGrasterizer *rast = NULL;
-  unsigned char *localData = NULL;
-  unsigned *dp;
-  size_t i, len;
+/**
+\brief returns a copy of the image memory report, taken while no frame
+updates it.
+*/
+imageMemoryReport uxdevice::platform::imageMemoryStatus(void) {
+  std::lock_guard<std::mutex> lock(m_imageMemoryMutex);
+  return m_imageMemory;
+}
 
-  if ((localData = stbi_load(_fileName->data(), &w, &h, &n, 4)))
-    ;
-  else if ((shapes = nsvgParseFromFile(_fileName->data(), "px", 96.0f))) {
-    w = (int)shapes->width;
-    h = (int)shapes->height;
-    rast = nsvgCreateRasterizer();
-    localData = reinterpret_cast<unsigned char *>(malloc(w * h * 4));
-    nsvgRasterize(rast, shapes, 0, 0, 1, localData, w, h, w * 4);
-  } else {
-    string info = "Cannot load the file: ";
-    info += *_fileName;
-    throw std::invalid_argument(info);
-  }
-  data = make_shared<vector<unsigned char>>();
-  data->reserve(w * h * 4);
-  unsigned int *p = reinterpret_cast<unsigned int *>(data->data());
-  for (i = 0, len = w * h, dp = (unsigned int *)localData; i < len; i++) {
-    *p = dp[i] & 0xff00ff00 | ((dp[i] >> 16) & 0xFF) |
-         ((dp[i] << 16) & 0xFF0000);
-    p++;
+/**
+\internal
+\brief The function applies the image memory policy. It is called after
+each frame. Images that are no longer referenced are dropped from the list.
+*/
+void uxdevice::platform::evictImages(void) {
+  auto now = std::chrono::steady_clock::now();
+  vector<shared_ptr<imageCache>> idle;
+  size_t resident = 0;
+  std::lock_guard<std::mutex> lock(m_imageMemoryMutex);
+
+  for (auto it = m_images.begin(); it != m_images.end();) {
+    shared_ptr<imageCache> cache = it->lock();
+    if (!cache) {
+      it = m_images.erase(it);
+      continue;
+    }
+
+    resident += cache->residentBytes();
+    if (now - cache->lastUsed > m_imageIdleWindow)
+      idle.push_back(cache);
+    it++;
   }
-  width = make_shared<int>(w);
-  height = make_shared<int>(h);
 
-  free(localData);
+  sort(idle.begin(), idle.end(),
+       [](const shared_ptr<imageCache> &a, const shared_ptr<imageCache> &b) {
+         return a->lastUsed < b->lastUsed;
+       });
 
-#elif defined(USE_IMAGE_MAGICK)
-  data = make_shared<Magick::Image>();
-  data->type(Magick::TrueColorType);
-  data->backgroundColor("None");
-  data->read(*_fileName);
-  Magick::Color bg_color = data->pixelColor(0,0);
-  data->transparent(bg_color);
-  //data-> matte(true);
-#endif // USE_IMAGE_MAGICK
+  for (auto &cache : idle) {
+    if (resident <= m_imageMemory.budgetBytes)
+      break;
+
+    size_t bytes = cache->evict();
+    if (bytes) {
+      resident -= std::min(bytes, resident);
+      m_imageMemory.reclaimedBytes += bytes;
+      m_imageMemory.evictions++;
+    }
+  }
+
+  m_imageMemory.images = m_images.size();
+  m_imageMemory.residentBytes = resident;
 }
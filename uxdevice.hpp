@@ -26,7 +26,78 @@ options when compiling the source.
 #define DEFAULT_TEXTSIZE 12
 #define DEFAULT_TEXTCOLOR 0
 
+/**
+\def TILED_IMAGE_PIXELS
+\brief images with more pixels than this are not decoded into one bitmap.
+They are kept as tiles which are materialized when they become visible.
+*/
+#define TILED_IMAGE_PIXELS (4096 * 4096)
 
+/**
+\def TILED_IMAGE_CACHE_BYTES
+\brief the number of bytes of decoded tiles that a tiled image keeps
+resident. The least recently drawn tiles are released first.
+*/
+#define TILED_IMAGE_CACHE_BYTES (64 * 1024 * 1024)
+
+/**
+\def IMAGE_IDLE_MILLISECONDS
+\brief images which have not been drawn within this time may be evicted
+from memory. They are restored when they are drawn again.
+*/
+#define IMAGE_IDLE_MILLISECONDS 10000
+
+/**
+\def IMAGE_MEMORY_BUDGET
+\brief the number of bytes of decoded images the platform keeps resident
+before idle images are evicted.
+*/
+#define IMAGE_MEMORY_BUDGET (256 * 1024 * 1024)
+
+/**
+\def IMAGE_SPILL_DIRECTORY
+\brief the directory evicted images are written to. When it is not defined,
+the directory named by the UXDEVICE_SPILL_DIR environment variable is used,
+then $XDG_CACHE_HOME/uxdevice, $HOME/.cache/uxdevice and /var/tmp. These
+are on disk, unlike /tmp which is often held in memory.
+*/
+//#define IMAGE_SPILL_DIRECTORY "/var/cache/uxdevice"
+
+/**
+\def SCREEN_BUFFERS
+\brief the number of shared memory buffers the window is drawn into, two or
+three. A buffer is presented while the next is drawn.
+*/
+#define SCREEN_BUFFERS 2
+
+/**
+\def PRESENT_DAMAGE_TILE
+\brief the size in pixels of the blocks that are compared with the previous
+frame to find the areas of the window that changed. Only the changed areas
+are copied to the window.
+*/
+#define PRESENT_DAMAGE_TILE 64
+
+/**
+\def PRESENT_DAMAGE_RECTS
+\brief the largest number of rectangles copied to the window per frame.
+Nearby rectangles are merged to stay within it.
+*/
+#define PRESENT_DAMAGE_RECTS 16
+
+/**
+\def OCCLUSION_RECTS
+\brief the largest number of image rectangles that hide the items drawn
+before them. The largest images are kept.
+*/
+#define OCCLUSION_RECTS 32
+
+/**
+\def FRAME_RATE
+\brief the frames per second produced when the X Present extension is not
+available to pace frames by the vertical blank.
+*/
+#define FRAME_RATE 60
 
 /**
 \def USE_DIRECT
@@ -73,6 +144,14 @@ against the USE_GREYSCALE_ANTIALIAS option. One one should be defined.
 */
 //#define USE_STB_IMAGE
 
+/**
+\def USE_RENDER_THREAD
+\brief frames are drawn by a render thread from a snapshot of the display
+list while the event thread continues to handle input. The display list is
+changed by the event thread.
+*/
+//#define USE_RENDER_THREAD
+
 /**
 \def USE_CHROMIUM_EMBEDDED_FRAMEWORK
 \brief The system will be configured to use the CEF system.
@@ -84,6 +163,7 @@ against the USE_GREYSCALE_ANTIALIAS option. One one should be defined.
 #include <algorithm>
 #include <any>
 #include <array>
+#include <chrono>
 #include <cstdint>
 
 #if defined(_WIN64)
@@ -91,6 +171,7 @@ typedef unsigned char u_int8_t;
 #endif
 
 #include <cctype>
+#include <cerrno>
 #include <climits>
 #include <cmath>
 #include <cstdarg>
@@ -103,6 +184,8 @@ typedef unsigned char u_int8_t;
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <list>
 #include <map>
 #include <memory>
 #include <optional>
@@ -120,6 +203,10 @@ typedef unsigned char u_int8_t;
 #include <variant>
 #include <vector>
 #include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 /*************************************
 OS SPECIFIC HEADERS
@@ -134,6 +221,7 @@ OS SPECIFIC HEADERS
 #include <X11/keysym.h>
 #include <X11/keysymdef.h>
 #include <fontconfig/fontconfig.h>
+#include <xcb/present.h>
 #include <xcb/shm.h>
 #include <xcb/xcb_image.h>
 #include <xcb/xcb_keysyms.h>
@@ -171,6 +259,10 @@ EXTERN_C IMAGE_DOS_HEADER __ImageBase;
 
 #endif // image processing
 
+#ifdef USE_STB_IMAGE
+struct NSVGimage;
+#endif // USE_STB_IMAGE
+
 namespace uxdevice {
 
 class event;
@@ -282,17 +374,290 @@ public:
   int y2;
 };
 
+/**
+\class stringData
+\brief selects the text drawn by the following drawText nodes. text is the
+index of the string within the pool of the display list.
+*/
 using stringData = class stringData {
 public:
-  std::shared_ptr<std::string> data;
+  std::uint32_t text = 0;
   bool bWordBreaks = true;
 };
 
+/**
+\enum imageFit
+\brief the imageFit enumeration selects how a drawImage places the image
+within the targetArea. crop is the original behavior, the image is drawn at
+its natural size and clipped. fit scales the image, keeping its aspect ratio,
+to the largest size that is contained within the area and centers it. stretch
+scales the image to the exact size of the area.
+*/
+enum class imageFit : uint8_t { crop, fit, stretch };
+
+/**
+\enum pixelFormat
+\brief the byte order of 32 bit pixels in memory.
+*/
+enum class pixelFormat : uint8_t { rgba, bgra, argb };
+
+/**
+\class pixelConvert
+\brief The pixelConvert class holds the pixel format conversions used when
+images are loaded and when pixels are presented. Each function converts a
+span of count pixels. Quanta are the channel values of the Magick pixel
+cache, channels is 3 or 4 ordered red, green, blue and optionally alpha.
+Floating point quanta are scaled by range, integer quanta use the full range
+of their type. The 8 bit side is always bgra.
+
+The implementation is selected once at run time from the instruction sets
+that the cpu supports, avx2, ssse3 or sse2, with portable code otherwise.
+All of the implementations produce the same results.
+*/
+using pixelConvert = class pixelConvert {
+public:
+  static void swizzle(const u_int8_t *src, const pixelFormat srcFormat,
+                      u_int8_t *dst, const pixelFormat dstFormat,
+                      const std::size_t count);
+  static void premultiply(const u_int8_t *src, u_int8_t *dst,
+                          const std::size_t count);
+  static void unpremultiply(const u_int8_t *src, u_int8_t *dst,
+                            const std::size_t count);
+
+  static void fromQuantum(const float *src, const int channels,
+                          const float range, u_int8_t *dst,
+                          const std::size_t count);
+  static void fromQuantum(const uint16_t *src, const int channels,
+                          const float range, u_int8_t *dst,
+                          const std::size_t count);
+  static void fromQuantum(const u_int8_t *src, const int channels,
+                          const float range, u_int8_t *dst,
+                          const std::size_t count);
+  static void toQuantum(const u_int8_t *src, float *dst, const int channels,
+                        const float range, const std::size_t count);
+  static void toQuantum(const u_int8_t *src, uint16_t *dst,
+                        const int channels, const float range,
+                        const std::size_t count);
+  static void toQuantum(const u_int8_t *src, u_int8_t *dst,
+                        const int channels, const float range,
+                        const std::size_t count);
+
+  static void blend(u_int8_t *dst, const u_int8_t *coverage,
+                    const int coverageStep, const unsigned int color,
+                    const std::size_t count);
+  static void fill(u_int8_t *dst, const unsigned int color,
+                   const std::size_t count);
+
+  static const char *implementation(void);
+};
+
+/**
+\class imageBuffer
+\brief describes a block of 32 bit bgra pixels. The storage member keeps the
+memory that pixels points to alive, for instance a std::vector, so that the
+buffer may be copied freely.
+*/
+using imageBuffer = class imageBuffer {
+public:
+  imageBuffer() {}
+  imageBuffer(const int _width, const int _height);
+
+  int width = 0;
+  int height = 0;
+  int stride = 0;
+  u_int8_t *pixels = nullptr;
+  std::shared_ptr<void> storage;
+};
+
+/**
+\class surface
+\brief the 32 bit bgra pixels that a frame is drawn into. Rows are stride
+bytes apart. Drawing is limited to the clip rectangle, which always lies
+within the surface, so callers pass unclipped coordinates and whole spans.
+The clip is further limited to the bounds, the part of the frame being
+drawn again.
+*/
+using surface = class surface {
+public:
+  surface() {}
+  surface(u_int8_t *_pixels, const int _width, const int _height,
+          const int _stride);
+
+  u_int8_t *row(const int y) const {
+    return pixels + static_cast<std::ptrdiff_t>(y) * stride;
+  }
+
+  void limit(const rectangle &r);
+  void clip(const rectangle &r);
+  void unclip(void) { m_clip = m_bounds; }
+  const rectangle &clipArea(void) const { return m_clip; }
+
+  void clear(const unsigned int color);
+  void fill(const rectangle &r, const unsigned int color);
+  void copy(const int x, const int y, const imageBuffer &src, const int srcX,
+            const int srcY, const int w, const int h);
+  void blend(const int x, const int y, const u_int8_t *coverage,
+             const int coverageStep, const unsigned int color,
+             const int count);
+
+  u_int8_t *pixels = nullptr;
+  int width = 0;
+  int height = 0;
+  int stride = 0;
+
+private:
+  rectangle m_bounds = rectangle(0, 0, 0, 0);
+  rectangle m_clip = rectangle(0, 0, 0, 0);
+};
+
+/**
+\class imageCache
+\brief The imageCache holds the source pixels of an image along with scaled
+variants of it. Two types of variants are kept. The mip chain, where each
+level is half of the size of the previous one, is built on demand using a box
+filter. Exact sized entries are kept for sizes which are drawn repeatedly,
+these are produced by a bilinear filter from the nearest mip level. When the
+requested size changes every frame, such as within a zoom animation, the
+nearest mip level is returned and the caller resamples from it.
+
+The cache owns decoded pixels. When the image has been idle, the platform
+may evict it. Owned source pixels are then written once to an unlinked
+temporary raw pixel file and are mapped back from it the next time the
+pixels are requested.
+
+In the stb build, an svg source keeps the parsed document rather than
+pixels. It is rasterized at the size it is drawn and each size is kept as an
+exact entry. When a new size is requested while another one exists, the
+existing raster is returned for resampling and the new size is rasterized in
+the background. The notify function is called from the background thread
+when a raster is ready.
+*/
+using imageCache = class imageCache {
+public:
+  imageCache() {}
+  imageCache(const imageCache &) = delete;
+  imageCache &operator=(const imageCache &) = delete;
+  ~imageCache();
+
+  void source(const imageBuffer &_source, const bool _bOwned = false);
+  const imageBuffer &source(void);
+  void levels(const std::vector<imageBuffer> &_levels);
+  const imageBuffer &lookup(const int w, const int h);
+  void invalidate(void);
+  int width(void);
+  int height(void);
+
+#if defined(USE_STB_IMAGE)
+  void vectorSource(const std::shared_ptr<NSVGimage> &_image);
+  imageBuffer rasterize(const int w, const int h);
+#endif
+  bool isVector(void);
+  void notify(const std::function<void(void)> &_ready) { m_ready = _ready; }
+  void wait(void);
+
+  void touch(void) { lastUsed = std::chrono::steady_clock::now(); }
+  bool evicted(void) { return m_bEvicted; }
+  std::size_t residentBytes(void);
+  std::size_t evict(void);
+
+  std::chrono::steady_clock::time_point lastUsed =
+      std::chrono::steady_clock::now();
+  bool bTracked = false;
+
+private:
+  const imageBuffer &mip(const int w, const int h);
+  void restore(void);
+  bool spill(void);
+
+  imageBuffer m_source;
+  bool m_bOwned = false;
+  bool m_bEvicted = false;
+  int m_spillFile = -1;
+  std::size_t m_seededLevels = 0;
+  std::vector<imageBuffer> m_mips;
+  std::list<imageBuffer> m_entries;
+  int m_lastWidth = 0;
+  int m_lastHeight = 0;
+  static const std::size_t maxEntries = 4;
+
+#if defined(USE_STB_IMAGE)
+  const imageBuffer &lookupVector(const int w, const int h);
+
+  typedef struct {
+    int width;
+    int height;
+    std::future<imageBuffer> result;
+    std::future<void> task;
+  } pendingRaster;
+
+  std::shared_ptr<NSVGimage> m_vector;
+  std::list<pendingRaster> m_pending;
+#endif
+  std::function<void(void)> m_ready;
+};
+
+/**
+\class imageMemoryReport
+\brief reports the state of the image memory budget of the platform.
+reclaimedBytes, evictions and restores accumulate from the creation of the
+platform.
+*/
+using imageMemoryReport = class imageMemoryReport {
+public:
+  std::size_t images = 0;
+  std::size_t residentBytes = 0;
+  std::size_t budgetBytes = IMAGE_MEMORY_BUDGET;
+  std::size_t reclaimedBytes = 0;
+  std::size_t evictions = 0;
+  std::size_t restores = 0;
+};
+
+/**
+\class tiledImage
+\brief A tiledImage represents an image which is too large to be decoded as
+a whole. The image is divided into square tiles that are decoded on demand
+by the decoder function when drawing touches them. The decoded tiles are
+kept within a least recently used list bounded by a number of bytes.
+*/
+using tiledImage = class tiledImage {
+public:
+  typedef std::function<void(const int x, const int y, imageBuffer &tile)>
+      tileDecoder;
+
+  tiledImage(const int _width, const int _height, const tileDecoder &_decoder,
+             const std::size_t _capacity = TILED_IMAGE_CACHE_BYTES);
+  const imageBuffer &tile(const int tx, const int ty);
+
+  static const int tileSize = 256;
+  int width;
+  int height;
+
+private:
+  typedef std::pair<int64_t, imageBuffer> tileEntry;
+
+  tileDecoder m_decoder;
+  std::list<tileEntry> m_tiles;
+  std::unordered_map<int64_t, std::list<tileEntry>::iterator> m_index;
+  std::size_t m_capacity;
+  std::size_t m_residentBytes = 0;
+};
+
+/**
+\class imageData
+\brief an image within the display list. The decoded pixels are owned by
+the cache so that they may be evicted. Every source holds premultiplied bgra
+pixels, decoded images are premultiplied as they are loaded. In the stb
+build, data refers to the premultiplied pixels supplied by the client. In
+the Magick build, data is kept only for tiled images, others are converted
+to bgra as they are loaded.
+*/
 using imageData = class imageData {
 public:
   imageData(std::shared_ptr<int> _width, std::shared_ptr<int> _height,
             std::shared_ptr<std::vector<u_int8_t>> _data);
   imageData(std::shared_ptr<std::string> _fileName);
+  void writeRaw(const std::string &sFileName, const bool bMipLevels = false,
+                const double dScale = 1.0);
 
 #if defined(USE_STB_IMAGE)
   std::shared_ptr<int> width;
@@ -304,46 +669,532 @@ public:
 #endif
 
   std::shared_ptr<std::string> fileName;
+  std::shared_ptr<imageCache> cache;
+  std::shared_ptr<tiledImage> tiles;
+
+private:
+  bool mapRaw(const std::string &sFileName);
+};
+
+/**
+\class imageSource
+\brief selects the image drawn by the following drawImage nodes. image is
+the index of the image within the pool of the display list.
+*/
+using imageSource = class imageSource {
+public:
+  std::uint32_t image = 0;
 };
 
+/**
+\class textFace
+\brief selects the font. face is the index of the face name within the
+string pool of the display list.
+*/
 using textFace = class textFace {
 public:
-  std::shared_ptr<std::string> data;
-  std::shared_ptr<int> pointSize;
+  std::uint32_t face = 0;
+  int pointSize = 10;
 };
 
 using textColor = class textColor {
 public:
-  std::shared_ptr<unsigned int> data;
+  unsigned int data = 0;
 };
 using textAlignment = class textAlignment {
 public:
-  std::shared_ptr<char> data;
+  char data = 'l';
 };
 
 using targetArea = class targetArea {
 public:
-  std::shared_ptr<rectangle> data;
+  rectangle data = rectangle(0, 0, 0, 0);
 };
 
 using catchEvent = class catchEvent {
 public:
-  std::shared_ptr<eventHandler> data;
+  std::uint32_t handler = 0;
 };
 using drawText = class drawText {
 public:
-  std::shared_ptr<std::size_t> beginIndex;
-  std::shared_ptr<std::size_t> endIndex;
+  std::size_t beginIndex = 0;
+  std::size_t endIndex = 0;
 };
 using drawImage = class drawImage {
 public:
-  std::shared_ptr<rectangle> src;
+  std::optional<rectangle> src;
+  std::optional<imageFit> fit;
+};
+
+/**
+\class itemKey
+\brief names the item drawn by the next drawText or drawImage node. Items
+with the same key are matched when two lists are compared, others are
+matched by their position.
+*/
+using itemKey = class itemKey {
+public:
+  std::uint64_t key = 0;
 };
 
-typedef std::variant<stringData, imageData, textFace, textColor, textAlignment,
-                     targetArea, catchEvent, drawText, drawImage>
+/**
+\class pushClip
+\brief limits the nodes up to the matching popClip to data. Clips nest, the
+area drawn is the intersection of the clips pushed and the target area.
+*/
+using pushClip = class pushClip {
+public:
+  rectangle data = rectangle(0, 0, 0, 0);
+};
+
+/**
+\class popClip
+\brief restores the clip in effect before the matching pushClip.
+*/
+using popClip = class popClip {};
+
+/**
+\class affine
+\brief a two dimensional affine transform. A point x, y is moved to
+xx * x + xy * y + x0, yx * x + yy * y + y0.
+*/
+using affine = class affine {
+public:
+  double xx = 1.0;
+  double yx = 0.0;
+  double xy = 0.0;
+  double yy = 1.0;
+  double x0 = 0.0;
+  double y0 = 0.0;
+
+  static affine translation(const double dx, const double dy) {
+    return affine{1.0, 0.0, 0.0, 1.0, dx, dy};
+  }
+  static affine scaling(const double sx, const double sy) {
+    return affine{sx, 0.0, 0.0, sy, 0.0, 0.0};
+  }
+  static affine rotation(const double radians);
+
+  affine operator*(const affine &o) const;
+  affine inverse(void) const;
+
+  // the transform moves by whole pixels only.
+  bool isTranslation(void) const {
+    return xx == 1.0 && yx == 0.0 && xy == 0.0 && yy == 1.0 &&
+           x0 == std::floor(x0) && y0 == std::floor(y0);
+  }
+  // rectangles stay rectangles of the same orientation.
+  bool isAxisAligned(void) const {
+    return yx == 0.0 && xy == 0.0 && xx > 0.0 && yy > 0.0;
+  }
+  // the lengths the x and y axes are scaled by.
+  double scaleX(void) const { return std::hypot(xx, yx); }
+  double scaleY(void) const { return std::hypot(xy, yy); }
+
+  rectangle map(const rectangle &r) const;
+};
+
+/**
+\class pushTransform
+\brief moves, scales or rotates the nodes up to the matching popTransform.
+Transforms nest, data is applied before the transforms pushed earlier. The
+rectangles of targetArea and pushClip nodes are mapped when their items are
+drawn. Text is drawn upright, its glyphs scaled by the lengths of the
+transformed axes, within the bounds of the mapped area.
+*/
+using pushTransform = class pushTransform {
+public:
+  affine data;
+};
+
+/**
+\class popTransform
+\brief restores the transform in effect before the matching pushTransform.
+*/
+using popTransform = class popTransform {};
+
+typedef std::variant<stringData, imageSource, textFace, textColor,
+                     textAlignment, targetArea, catchEvent, drawText,
+                     drawImage, itemKey, pushClip, popClip, pushTransform,
+                     popTransform>
     displayListType;
 
+/**
+\class cowVector
+\brief a vector held in chunks of chunkSize values that are shared between
+copies. Copying the vector copies the chunk pointers. A shared chunk is
+copied before it is written, so a copy keeps the values it was taken with.
+*/
+template <typename T> class cowVector {
+public:
+  static const std::size_t chunkSize = 256;
+  typedef std::vector<T> chunk;
+
+  class const_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const T *pointer;
+    typedef const T &reference;
+
+    const_iterator(const cowVector *_v, const std::size_t _idx)
+        : m_v(_v), m_idx(_idx) {}
+    const T &operator*() const { return (*m_v)[m_idx]; }
+    const T *operator->() const { return &(*m_v)[m_idx]; }
+    const_iterator &operator++() {
+      m_idx++;
+      return *this;
+    }
+    bool operator==(const const_iterator &o) const { return m_idx == o.m_idx; }
+    bool operator!=(const const_iterator &o) const { return m_idx != o.m_idx; }
+
+  private:
+    const cowVector *m_v;
+    std::size_t m_idx;
+  };
+
+  const T &operator[](const std::size_t idx) const {
+    return (*m_chunks[idx / chunkSize])[idx % chunkSize];
+  }
+  T &write(const std::size_t idx) {
+    return (*own(idx / chunkSize))[idx % chunkSize];
+  }
+  template <typename... Args> T &emplace_back(Args &&... args) {
+    if (m_size % chunkSize == 0) {
+      m_chunks.push_back(std::make_shared<chunk>());
+      m_chunks.back()->reserve(chunkSize);
+    }
+    chunk *c = own(m_chunks.size() - 1);
+    c->emplace_back(std::forward<Args>(args)...);
+    m_size++;
+    return c->back();
+  }
+  void push_back(const T &value) { emplace_back(value); }
+  void push_back(T &&value) { emplace_back(std::move(value)); }
+  std::size_t size(void) const { return m_size; }
+  void reserve(const std::size_t n) {
+    m_chunks.reserve((n + chunkSize - 1) / chunkSize);
+  }
+  void clear(void) {
+    m_chunks.clear();
+    m_size = 0;
+  }
+  void swap(cowVector &other) {
+    m_chunks.swap(other.m_chunks);
+    std::swap(m_size, other.m_size);
+  }
+  const_iterator begin(void) const { return const_iterator(this, 0); }
+  const_iterator end(void) const { return const_iterator(this, m_size); }
+
+private:
+  // the copies sharing a chunk are only made by the thread writing, others
+  // may only release theirs. The fence orders their reads before the write.
+  chunk *own(const std::size_t c) {
+    if (m_chunks[c].use_count() > 1)
+      m_chunks[c] = std::make_shared<chunk>(*m_chunks[c]);
+    else
+      std::atomic_thread_fence(std::memory_order_acquire);
+    return m_chunks[c].get();
+  }
+
+  std::vector<std::shared_ptr<chunk>> m_chunks;
+  std::size_t m_size = 0;
+};
+
+/**
+\class pooledString
+\brief a string of the pool of a display list. A string loaded from a file
+refers to the mapping of the file until it is written.
+*/
+using pooledString = class pooledString {
+public:
+  pooledString(std::string s) : m_owned(std::move(s)) {}
+  static pooledString mapped(const std::string_view s) {
+    pooledString ret{std::string()};
+    ret.m_mapped = s;
+    ret.m_bMapped = true;
+    return ret;
+  }
+  std::string_view view(void) const {
+    return m_bMapped ? m_mapped : std::string_view(m_owned);
+  }
+  std::string &owned(void) {
+    if (m_bMapped) {
+      m_owned.assign(m_mapped);
+      m_bMapped = false;
+    }
+    return m_owned;
+  }
+
+private:
+  std::string m_owned;
+  std::string_view m_mapped;
+  bool m_bMapped = false;
+};
+
+/**
+\class displayHandle
+\brief names a node of a displayList by its position. Nodes are not moved,
+so a handle remains valid as the list grows and within the later versions
+of the list. The node is read with list[handle] and changed in place with
+list.write(handle).
+*/
+template <typename T> class displayHandle {
+public:
+  displayHandle() {}
+  explicit displayHandle(const std::uint32_t _index) : index(_index) {}
+
+  std::uint32_t index = 0;
+};
+
+/**
+\class displayList
+\brief the nodes of the display list are values held in chunks. The
+strings, images and event handlers they refer to are kept within pools of
+the list and are named by index, so a node is a few bytes and traversal
+does not follow a pointer per field. A copy of the list shares the chunks
+until either copy writes them, so a snapshot costs a pointer per chunk.
+
+Values are changed only through the write functions. Each write advances
+the generation of the list and stamps the value written with it, so the
+renderer finds what changed since a frame by comparing generations. A
+list assigned over another continues its generations, all of its nodes
+count as written by the assignment.
+
+save writes the list in a binary format and load maps such a file. The
+strings of a loaded list refer to the mapping, it is installed by
+assigning it to the list of a transaction.
+*/
+using displayList = class displayList {
+public:
+  typedef cowVector<displayListType>::const_iterator const_iterator;
+
+  displayList() = default;
+  displayList(const displayList &) = default;
+  displayList(displayList &&) = default;
+  displayList &operator=(displayList other);
+
+  template <typename T>
+  displayHandle<std::decay_t<T>> push_back(T &&node) {
+    m_nodes.emplace_back(std::forward<T>(node));
+    m_written.push_back(++m_generation);
+    return displayHandle<std::decay_t<T>>(m_nodes.size() - 1);
+  }
+
+  // constructs a node of type T from the values of its fields.
+  template <typename T, typename... Args>
+  displayHandle<T> emplace_back(Args &&... args) {
+    m_nodes.emplace_back(std::in_place_type<T>,
+                         T{std::forward<Args>(args)...});
+    m_written.push_back(++m_generation);
+    return displayHandle<T>(m_nodes.size() - 1);
+  }
+
+  // appends a range of nodes, or of values of a node type.
+  template <typename InputIt> void append(InputIt first, InputIt last) {
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                                    typename std::iterator_traits<
+                                        InputIt>::iterator_category>)
+      reserve(size() + std::distance(first, last));
+    for (; first != last; ++first)
+      push_back(*first);
+  }
+
+  std::uint32_t addString(std::string s) {
+    m_strings.push_back(pooledString(std::move(s)));
+    m_stringWritten.push_back(++m_generation);
+    return m_strings.size() - 1;
+  }
+  std::string_view string(const std::uint32_t id) const {
+    return m_strings[id].view();
+  }
+  std::string &writeString(const std::uint32_t id) {
+    m_stringWritten.write(id) = ++m_generation;
+    return m_strings.write(id).owned();
+  }
+
+  std::uint32_t addImage(imageData image) {
+    m_images.push_back(std::move(image));
+    m_imageWritten.push_back(++m_generation);
+    return m_images.size() - 1;
+  }
+  const imageData &image(const std::uint32_t id) const {
+    return m_images[id];
+  }
+  imageData &writeImage(const std::uint32_t id) {
+    m_imageWritten.write(id) = ++m_generation;
+    return m_images.write(id);
+  }
+
+  std::uint32_t addHandler(const eventHandler &fn) {
+    m_handlers.push_back(fn);
+    return m_handlers.size() - 1;
+  }
+  const eventHandler &handler(const std::uint32_t id) const {
+    return m_handlers[id];
+  }
+
+  const displayListType &operator[](const std::size_t idx) const {
+    return m_nodes[idx];
+  }
+  template <typename T>
+  const T &operator[](const displayHandle<T> &handle) const {
+    return std::get<T>(m_nodes[handle.index]);
+  }
+  displayListType &write(const std::size_t idx) {
+    m_written.write(idx) = ++m_generation;
+    return m_nodes.write(idx);
+  }
+  template <typename T> T &write(const displayHandle<T> &handle) {
+    return std::get<T>(write(handle.index));
+  }
+  void touch(const std::size_t idx) { m_written.write(idx) = ++m_generation; }
+
+  std::uint64_t generation(void) const { return m_generation; }
+  std::uint64_t generation(const std::size_t idx) const;
+  std::vector<std::size_t> changes(const std::uint64_t since) const;
+
+  std::size_t size(void) const { return m_nodes.size(); }
+  bool empty(void) const { return m_nodes.size() == 0; }
+  void reserve(const std::size_t nodes, const std::size_t strings = 0);
+  void clear(void);
+  void swap(displayList &other);
+
+  const_iterator begin(void) const { return m_nodes.begin(); }
+  const_iterator end(void) const { return m_nodes.end(); }
+
+  void save(const std::string &sFileName) const;
+  static displayList load(const std::string &sFileName);
+
+private:
+  cowVector<displayListType> m_nodes;
+  cowVector<pooledString> m_strings;
+  cowVector<imageData> m_images;
+  cowVector<eventHandler> m_handlers;
+
+  /* the generation of the last write of each node and pooled value. Nodes
+  written before the list was assigned count as written at m_assigned. */
+  std::uint64_t m_generation = 0;
+  std::uint64_t m_assigned = 0;
+  cowVector<std::uint64_t> m_written;
+  cowVector<std::uint64_t> m_stringWritten;
+  cowVector<std::uint64_t> m_imageWritten;
+
+  // the file mapping the strings of a loaded list refer to.
+  std::shared_ptr<const void> m_mapping;
+};
+
+class platform;
+
+/**
+\class displayBuilder
+\brief appends the nodes of a scene to a list. Face names are interned so
+that items of the same face share its string, and a face, color or
+alignment node is only added when it differs from the one in effect. text
+and image add the source and draw nodes of an item in one call.
+*/
+using displayBuilder = class displayBuilder {
+public:
+  displayBuilder(displayList &_list) : m_list(_list) {}
+  displayBuilder &reserve(const std::size_t nodes,
+                          const std::size_t strings = 0);
+  displayBuilder &face(const std::string &name, const int pointSize);
+  displayBuilder &color(const unsigned int c);
+  displayBuilder &alignment(const char a);
+  displayBuilder &area(const rectangle &r);
+  displayBuilder &key(const std::uint64_t k);
+  displayBuilder &pushClip(const rectangle &r);
+  displayBuilder &popClip(void);
+  displayBuilder &pushTransform(const affine &t);
+  displayBuilder &popTransform(void);
+  displayBuilder &text(std::string s, const bool bWordBreaks = true);
+  displayBuilder &image(imageData image,
+                        const std::optional<imageFit> fit = {},
+                        const std::optional<rectangle> src = {});
+
+  // other nodes are added as they are. A state node given here is taken as
+  // the one in effect.
+  template <typename T, typename... Args>
+  displayHandle<T> emplace(Args &&... args) {
+    displayHandle<T> h = m_list.emplace_back<T>(std::forward<Args>(args)...);
+    if constexpr (std::is_same_v<T, textFace>)
+      m_face = m_list[h];
+    else if constexpr (std::is_same_v<T, textColor>)
+      m_color = m_list[h].data;
+    else if constexpr (std::is_same_v<T, textAlignment>)
+      m_alignment = m_list[h].data;
+    return h;
+  }
+
+private:
+  displayList &m_list;
+  std::unordered_map<std::string, std::uint32_t> m_faces;
+  std::optional<textFace> m_face;
+  std::optional<unsigned int> m_color;
+  std::optional<char> m_alignment;
+};
+
+/**
+\enum changeType
+\brief how an item differs between two display lists.
+*/
+enum class changeType : uint8_t { inserted, removed, changed };
+
+/**
+\class displayChange
+\brief an item that differs between two display lists. An item is a
+drawText or drawImage node along with the state in effect, its bounds are
+the targetArea it is drawn within. oldNode and oldBounds refer to the old
+list and are not set for an inserted item, newNode and newBounds refer to
+the new list and are not set for a removed item.
+*/
+using displayChange = class displayChange {
+public:
+  changeType type;
+  std::size_t oldNode;
+  std::size_t newNode;
+  rectangle oldBounds;
+  rectangle newBounds;
+};
+
+/**
+\class displayDiff
+\brief compares two display lists. Items are matched by their itemKey, or
+by their position among the items without one. A matched item is changed
+when its bounds, its state, its text or its image differ, when it is drawn
+in a different order relative to the other keyed items, or when a node it
+depends on was written, or touched, after the generation of before.
+*/
+using displayDiff = class displayDiff {
+public:
+  displayDiff(const displayList &before, const displayList &after);
+  std::vector<rectangle> damage(void) const;
+
+  std::vector<displayChange> changes;
+};
+
+/**
+\class displayTransaction
+\brief a set of edits of the display list of a platform, made by any
+thread. The transaction edits a copy of the published list which shares its
+chunks, and commit publishes the copy as a whole. Transactions are
+serialized, while the renderer keeps reading the list published last
+without waiting. Edits not committed are discarded.
+*/
+using displayTransaction = class displayTransaction {
+public:
+  displayTransaction(platform &_platform);
+  displayList &operator*() { return m_list; }
+  displayList *operator->() { return &m_list; }
+  void commit(void);
+
+private:
+  platform &m_platform;
+  std::unique_lock<std::mutex> m_lock;
+  displayList m_list;
+};
+
 /**
 \internal
 \class platform
@@ -358,38 +1209,98 @@ public:
                   const unsigned short height);
   void closeWindow(void);
 
-  std::vector<displayListType> &data(void);
-  void dirty(std::size_t idx) { m_dirty.push_back(idx); }
+  displayTransaction transaction(void) { return displayTransaction(*this); }
+  std::shared_ptr<const displayList> published(void) const {
+    return std::atomic_load(&m_published);
+  }
+  void dirty(std::size_t idx);
+  void scroll(const rectangle &area, const int dx, const int dy);
   int pixelWidth(std::size_t idx) { return 0; }
   int pixelHeight(std::size_t idx) { return 0; }
-  void render();
+  void render(std::shared_ptr<const displayList> list = {});
+  void render(const displayList &list, const int scale);
   void processEvents(void);
   void dispatchEvent(const event &e);
   int measureTextWidth(const std::string &sTextFace, const int pointSize,
                        const std::string &s);
   int measureFaceHeight(const std::string &sTextFace, const int pointSize);
+  void imageMemory(const std::chrono::milliseconds &idleWindow,
+                   const std::size_t budgetBytes);
+  imageMemoryReport imageMemoryStatus(void);
+  void sortState(const bool bSort) { m_bSortState = bSort; }
 
 private:
-  std::vector<displayListType> DL;
-  std::vector<std::size_t> m_dirty;
-  std::shared_ptr<rectangle> m_targetArea;
-  std::shared_ptr<std::string> m_stringData;
-
-#if defined(USE_STB_IMAGE)
-  std::shared_ptr<std::vector<u_int8_t>> m_imageData;
-  std::shared_ptr<int> m_width;
-  std::shared_ptr<int> m_height;
-
-#elif defined(USE_IMAGE_MAGICK)
-  std::shared_ptr<Magick::Image> m_image;
-
-#endif
+  friend class displayTransaction;
+  void publish(std::shared_ptr<const displayList> list);
+  void wake(void);
+  void applyScrolls(void);
+
+  /* the list published by the last transaction. It is replaced atomically,
+  a reader keeps the version it loaded for as long as it holds it. */
+  std::shared_ptr<const displayList> m_published =
+      std::make_shared<const displayList>();
+  std::mutex m_transactionMutex;
+  bool m_bSceneChanged = true;
+
+  /* the generation of the display list when the last frame was drawn, and
+  when the last scroll was stated. Changes made before a scroll are taken
+  to be the move. */
+  std::uint64_t m_drawnGeneration = 0;
+  std::uint64_t m_scrollGeneration = 0;
+
+  // the list drawn by the event thread and its font scale. The items of the
+  // next list that differ from it are drawn.
+  std::shared_ptr<const displayList> m_drawnList;
+  int m_drawnScale = 0;
+  bool sceneChanged(void) const {
+    return m_bSceneChanged || published()->generation() != m_drawnGeneration;
+  }
+  bool scrollOnly(const displayList &list) const {
+    return m_scrolls.size() == 1 && !m_bSceneChanged &&
+           list.generation() == m_scrollGeneration;
+  }
 
-  std::shared_ptr<std::string> m_textFace;
-  std::shared_ptr<int> m_pointSize;
+  /* a scroll moves the pixels of area by dx, dy. When it is the only change
+  of a frame, the pixels are moved and only the exposed strips are drawn. */
+  typedef struct {
+    rectangle area;
+    int dx;
+    int dy;
+  } scrollMove;
+  std::vector<scrollMove> m_scrolls;
+
+  /* scroll may be called by any thread, the moves are posted under
+  m_scrollMutex with the generation of the list they refer to and applied to
+  m_scrolls by the message loop. */
+  std::mutex m_scrollMutex;
+  std::vector<scrollMove> m_postedScrolls;
+  std::uint64_t m_postedGeneration = 0;
+  std::atomic<bool> m_bScrollPosted{false};
+  rectangle m_targetArea = rectangle(0, 0, 0, 0);
+  std::string_view m_stringData;
+
+  /* the transform of the item drawn, m_targetArea is m_localArea mapped by
+  it. The face is activated for the axis lengths m_textScaleX, Y. */
+  affine m_transform;
+  rectangle m_localArea = rectangle(0, 0, 0, 0);
+  double m_textScaleX = 1.0;
+  double m_textScaleY = 1.0;
+
+  std::shared_ptr<imageCache> m_imagePixels;
+  std::shared_ptr<tiledImage> m_imageTiles;
+  std::list<std::weak_ptr<imageCache>> m_images;
+  /* the policy and counters are written by the thread that draws and read
+  by any thread, m_imageMemoryMutex guards them. */
+  std::mutex m_imageMemoryMutex;
+  std::chrono::milliseconds m_imageIdleWindow{IMAGE_IDLE_MILLISECONDS};
+  imageMemoryReport m_imageMemory;
+  float m_deviceScale = 1.0f;
+
+  std::string_view m_textFace;
+  int m_pointSize = 10;
 
 #if defined(USE_DIRECT_SCREEN_OUTPUT)
-  std::shared_ptr<unsigned int> m_textColor;
+  unsigned int m_textColor = 0;
   unsigned char m_textColorR;
   unsigned char m_textColorG;
   unsigned char m_textColorB;
@@ -399,7 +1310,7 @@ private:
   std::shared_ptr<Magick::Color> m_textColor;
 #endif // defined
 
-  std::shared_ptr<char> m_textAlignment;
+  char m_textAlignment = 'l';
 
   int m_xpos;
   int m_ypos;
@@ -407,8 +1318,6 @@ private:
 private:
   void drawCaret(const int x, const int y, const int h);
 
-  inline void putPixel(const int x, const int y, const unsigned int color);
-  inline unsigned int getPixel(const int x, const int y);
 
 
 #if defined(USE_FREETYPE)
@@ -418,12 +1327,58 @@ private:
   inline FTC_FaceID getFaceID(std::string sTextFace);
 #endif // defined
 
-  void renderImage(const rectangle &src);
+  /* the placement of an image within the target area. The visible part of
+  the image, at its scaled size, starts at srcX, srcY. */
+  typedef struct {
+    int srcX;
+    int srcY;
+    int destX;
+    int destY;
+    int destWidth;
+    int destHeight;
+    int scaledWidth;
+    int scaledHeight;
+  } imagePlacement;
+  imagePlacement placeImage(const drawImage &di, const rectangle &area,
+                            imageCache &pixels,
+                            const std::shared_ptr<tiledImage> &tiles,
+                            const double scaleX = 1.0,
+                            const double scaleY = 1.0);
+  void renderImage(const drawImage &di);
+  void renderImageTransformed(const drawImage &di);
+  void occlude(const displayList &list);
+  void renderSorted(const displayList &list);
+  std::atomic<bool> m_bSortState{false};
+  std::vector<rectangle> m_visible;
+  void trackImage(const std::shared_ptr<imageCache> &cache);
+  void evictImages(void);
   void messageLoop(void);
   void test(int x, int y);
 
-  void flip(void);
+  void flip(const std::optional<std::vector<rectangle>> &damage = {});
+  void requestFrame(void);
   void resize(const int w, const int h);
+#if defined(USE_DIRECT_SCREEN_OUTPUT) && defined(__linux__)
+  void releaseBuffers(void);
+  void acquireBuffer(void);
+  void present(const std::size_t index, std::vector<rectangle> &damage);
+  void putImage(const std::size_t index, const rectangle &r);
+  bool attachBuffer(const std::size_t index, const std::size_t capacity);
+  bool completion(xcb_generic_event_t *xcbEvent);
+  xcb_generic_event_t *nextEvent(void);
+  bool eventsPending(void);
+  void coalesceEvents(void);
+  bool frameNotify(xcb_generic_event_t *xcbEvent);
+  int frameTimeout(void);
+  void presentFrame(void);
+  void renderLoop(void);
+  bool scrollFrame(const displayList &list, const int scale,
+                   const scrollMove &move);
+  bool damageFrame(const displayList &list, const int scale,
+                   std::vector<rectangle> damage);
+  void syncBackBuffer(void);
+  void swapBuffers(void);
+#endif
   void clear(void);
 
 #if defined(USE_FREETYPE)
@@ -458,13 +1413,76 @@ private:
   xcb_screen_t *m_screen;
   xcb_drawable_t m_window;
   xcb_gcontext_t m_graphics;
-  xcb_pixmap_t m_pix;
-  xcb_shm_segment_info_t m_info;
 
   // xcb -- keyboard
   xcb_key_symbols_t *m_syms;
   uint32_t m_foreground;
-  u_int8_t *m_screenMemoryBuffer;
+
+  /* the frame is drawn directly into shared memory. A presented buffer is
+  read by the server until its completion event arrives. Events received
+  while waiting are kept in m_pendingEvents for the message loop, which
+  also holds the coalesced batch of events being handled. m_bCoalesced is
+  cleared when an event is kept outside of a batch. When the server
+  cannot attach shared memory, the buffers are held in local memory and the
+  frames are sent within put image requests. */
+  typedef struct {
+    xcb_shm_segment_info_t info;
+    bool bBusy;
+    std::vector<u_int8_t> local;
+  } shmBuffer;
+
+  std::vector<shmBuffer> m_buffers;
+  std::size_t m_backBuffer = 0;
+  std::size_t m_bufferCapacity = 0;
+  uint8_t m_shmCompletion = 0;
+  bool m_bSharedMemory = true;
+  std::size_t m_maxRequestBytes = 0;
+  std::vector<u_int8_t> m_packBuffer;
+  std::list<xcb_generic_event_t *> m_pendingEvents;
+  bool m_bCoalesced = true;
+
+  // areas of the window to present along with the changes of the next frame
+  std::vector<rectangle> m_damage;
+  bool m_bPresented = false;
+
+  /* the areas presented with each of the last frames, newest first. The
+  back buffer was drawn SCREEN_BUFFERS - 1 frames ago, it is outdated
+  within the areas of those frames. */
+  std::list<std::vector<rectangle>> m_presented;
+  void presented(const std::vector<rectangle> &areas);
+
+  /* a requested frame is produced at the next vertical blank, signalled by
+  the completion of a present notify msc request, or by a timer when the
+  present extension is not available. */
+  bool m_bFrameRequested = false;
+  bool m_bPresentPacing = false;
+  bool m_bMscPending = false;
+  uint8_t m_presentOpcode = 0;
+  uint32_t m_presentSerial = 0;
+  std::chrono::steady_clock::time_point m_frameTime;
+  std::chrono::steady_clock::time_point m_mscTime;
+
+  // an eventfd written when a display list is published or a scroll is
+  // posted, which wakes the message loop for other threads.
+  int m_wakeFd = -1;
+
+  /* with USE_RENDER_THREAD, m_renderThread draws the snapshots posted to
+  m_frameList. m_renderMutex is held while a frame is drawn, and by the event
+  thread to change the buffers or use the font cache. The busy state of the
+  buffers is guarded by m_bufferMutex alone since the render thread waits on
+  completion events read by the event thread. */
+  std::thread m_renderThread;
+  std::mutex m_renderMutex;
+  std::mutex m_bufferMutex;
+  std::condition_variable m_bufferAvailable;
+  std::mutex m_frameMutex;
+  std::condition_variable m_frameReady;
+  std::shared_ptr<const displayList> m_frameList;
+  int m_frameScale = 0;
+  std::optional<scrollMove> m_frameScroll;
+  bool m_bFramePosted = false;
+  bool m_bFrameFull = true;
+  std::atomic<bool> m_bRenderExit{false};
 
 #elif defined(USE_DIRECT_SCREEN_OUTPUT) && defined(_WIN64)
   HWND m_hwnd;
@@ -476,16 +1494,12 @@ private:
 #endif
 
   int fontScale;
+  int m_renderScale = 0;
 
-#if defined(USE_DIRECT_SCREEN_OUTPUT) && !defined(USE_IMAGE_MAGICK)
-  std::vector<u_int8_t> m_offscreenBuffer;
-
-
-#elif defined(USE_IMAGE_MAGICK)
-  Magick::Image m_offscreenImage;
-  Magick::Quantum *m_offscreenBuffer;
-
-
+  // the frame is drawn into shared memory on linux.
+  surface m_surface;
+#if defined(_WIN64)
+  std::vector<u_int8_t> m_offscreenStorage;
 #endif
 
 private: